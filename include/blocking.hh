@@ -0,0 +1,66 @@
+#pragma once
+
+#include <coroutine>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "common.hh"
+#include "runtime.hh"
+#include "task.hh"
+#include "thread_queue.hh"
+
+namespace birdsong {
+
+/* blocking pool threads are numbered from here, well clear of any
+ * runtimes workers, so the two never share an id in a Mutex */
+constexpr ThreadQueue::ThreadID BlockingThreadID = 1u << 16;
+
+/* process wide pool of threads that blocking syscalls are handed off to,
+ * such as file io, which always reports ready to poll(2) and so can't go
+ * through the reactor. started on first use */
+ThreadQueue& blocking_pool();
+
+/* runs fn on the blocking pool, resuming the awaiting
+ * task with its result once it has returned */
+template<typename F>
+class Blocking : public AwaitableBase
+{
+  using Result = std::invoke_result_t<F&>;
+
+public:
+  Blocking(F fn)
+    : m_fn(std::move(fn)) {};
+
+  Blocking(const Blocking&) = delete;
+  Blocking& operator=(const Blocking&) = delete;
+
+  bool await_ready() { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle)
+  {
+    auto rt = basic_handle_from_void(handle).promise().runtime;
+
+    /* the waker owns the task, & with it this awaitable,
+     * until the job has finished with both */
+    blocking_pool().push_task([this, waker = rt->create_waker()]() mutable {
+      m_result.emplace(m_fn());
+      waker.wake();
+    });
+  }
+
+  Result await_resume() { return std::move(*m_result); }
+
+private:
+  F m_fn;
+  std::optional<Result> m_result;
+};
+
+template<typename F>
+Blocking<std::decay_t<F>>
+blocking(F&& fn)
+{
+  return Blocking<std::decay_t<F>>(std::forward<F>(fn));
+}
+
+};
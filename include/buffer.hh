@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "atomic.hh"
+
+namespace birdsong {
+
+/* pool of byte buffers in power of two size classes.
+ * each thread keeps a small free list per class behind its own,
+ * uncontended lock, spilling over into a shared free list that is
+ * bounded in bytes. requests larger than the largest class are
+ * allocated exactly and freed on return.
+ * the pools state is reference counted, so buffers may outlive the
+ * pool they came from, and move freely between tasks & threads. */
+class BufferPool
+{
+public:
+  /* smallest size class, each class is double the last */
+  static constexpr std::size_t MinClass = 512;
+  static constexpr unsigned NumClasses = 12;
+  static constexpr std::size_t MaxClass = MinClass << (NumClasses - 1);
+
+  struct Config
+  {
+    /* size of the buffers handed out by get() without a size */
+    std::size_t buffer_size = 8192;
+
+    /* bytes kept in the shared free list across every class,
+     * buffers returned past this are freed */
+    std::size_t max_free_bytes = 8 << 20;
+
+    /* bytes per class each thread keeps for itself. classes larger
+     * than this always go straight to the shared free list */
+    std::size_t thread_cache_bytes = 256 << 10;
+
+    /* carve the size classes out of 2MB huge page slabs.
+     * slab memory is kept until the pool & every buffer from it are
+     * gone, so max_free_bytes doesn't apply, the pool just stays at
+     * its high water mark */
+    bool hugepages = false;
+  };
+
+  class Core;
+
+  /* one threads free lists for a single pool. the pool hands the
+   * buffers back itself when it is destroyed, so idle threads
+   * don't keep them around */
+  class Cache : public Atom
+  {
+  public:
+    struct Data
+    {
+      std::array<std::vector<std::byte*>, NumClasses> free;
+
+      /* set once the cache has been emptied for good */
+      bool dead = false;
+    };
+
+    Cache(std::shared_ptr<Core> const& core)
+      : core(core)
+      , id(core.get()) {};
+
+    Data& get_data(Atom::Key) { return m_data; }
+
+    std::weak_ptr<Core> const core;
+    Core const* const id;
+
+  private:
+    Data m_data;
+  };
+
+  /* shared state, kept alive by the pool & its buffers */
+  class Core : public Atom
+  {
+  public:
+    struct Data
+    {
+      std::array<std::vector<std::byte*>, NumClasses> free;
+      std::size_t free_bytes = 0;
+
+      /* huge page slabs, only unmapped once the core is gone */
+      std::vector<std::span<std::byte>> slabs;
+
+      /* every threads cache of the pool, emptied when it closes */
+      std::vector<std::weak_ptr<Cache>> caches;
+    };
+
+    Core(Config config)
+      : config(config) {};
+    ~Core();
+
+    /* a fresh buffer of the class, from the system or a new slab */
+    std::byte* allocate(unsigned cls);
+
+    /* a free buffer of the class, nullptr if there are none */
+    std::byte* take(unsigned cls);
+
+    /* moves up to n free buffers of the class into out */
+    void take(unsigned cls, std::vector<std::byte*>& out, unsigned n);
+
+    /* returns a buffer, freeing it if the free list is full */
+    void give(unsigned cls, std::byte* buf);
+
+    /* moves buffers off the back of in until only keep remain,
+     * freeing whatever the shared free list has no room for */
+    void give(unsigned cls, std::vector<std::byte*>& in, unsigned keep);
+
+    /* buffers of the class each thread keeps for itself */
+    unsigned cache_limit(unsigned cls) const;
+
+    Data& get_data(Atom::Key) { return m_data; }
+
+    Config const config;
+
+    /* set once the pool is destroyed */
+    std::atomic<bool> closed{ false };
+
+  private:
+    Data m_data;
+  };
+
+  /* owning handle to a buffer from the pool,
+   * returns the buffer to the pool when dropped */
+  class Buffer
+  {
+  public:
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    Buffer(Buffer&& rhs) noexcept
+      : m_core(std::move(rhs.m_core))
+      , m_data(rhs.m_data)
+      , m_size(rhs.m_size)
+      , m_class(rhs.m_class)
+    {
+      rhs.m_data = nullptr;
+    }
+    Buffer& operator=(Buffer&& rhs) noexcept
+    {
+      this->~Buffer();
+      return *new (this) Buffer(std::move(rhs));
+    }
+
+    ~Buffer();
+
+    std::byte* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    std::span<std::byte> span() const { return { m_data, m_size }; }
+
+  private:
+    friend class BufferPool;
+    Buffer(std::shared_ptr<Core> core,
+           std::byte* data,
+           std::size_t size,
+           unsigned cls)
+      : m_core(std::move(core))
+      , m_data(data)
+      , m_size(size)
+      , m_class(cls) {};
+
+    std::shared_ptr<Core> m_core;
+    std::byte* m_data;
+    std::size_t m_size;
+
+    /* NumClasses for buffers too large for any class */
+    unsigned m_class;
+  };
+
+  BufferPool();
+  BufferPool(Config config);
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  /* process wide pool that io adapters draw from by default */
+  static BufferPool& shared();
+
+  /* a buffer of buffer_size() bytes */
+  Buffer get();
+
+  /* a buffer of at least min_size bytes, rounded up to its class */
+  Buffer get(std::size_t min_size);
+
+  std::size_t buffer_size() const;
+
+  static std::size_t class_size(unsigned cls) { return MinClass << cls; }
+
+  /* smallest class that fits size, NumClasses if none do */
+  static unsigned class_for(std::size_t size);
+
+private:
+  std::shared_ptr<Core> m_core;
+};
+
+};
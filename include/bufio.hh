@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+
+#include "buffer.hh"
+#include "coro.hh"
+#include "io.hh"
+#include "runtime.hh"
+
+namespace birdsong {
+
+/* buffered adapter over any AsyncReader.
+ * the buffer is borrowed from the pool when a read needs it, and is
+ * handed back once it is drained, on the next call. a read that has to
+ * wait on the underlying reader holds the buffer whilst it waits.
+ * reads at least as large as the buffer bypass it entirely.
+ * a BufReader is itself an AsyncReader. */
+template<AsyncReader R>
+class BufReader
+{
+public:
+  BufReader(R& reader, BufferPool& pool = BufferPool::shared())
+    : m_reader(reader)
+    , m_pool(pool) {};
+
+  BufReader(const BufReader&) = delete;
+  BufReader& operator=(const BufReader&) = delete;
+
+  /* bytes currently buffered, without reading any more in */
+  std::span<std::byte const> buffered() const
+  {
+    if (not m_buf)
+      return {};
+    return { m_buf->data() + m_start, m_end - m_start };
+  }
+
+  /* drops bytes off of the front of the buffer,
+   * generally after they have been looked at with peek */
+  void consume(unsigned n) { m_start += std::min(n, m_end - m_start); }
+
+  Coro<IOResult<unsigned>> read(std::span<std::byte> out)
+  {
+    release_if_empty();
+
+    if (not m_buf && out.size_bytes() >= m_pool.buffer_size())
+      co_return co_await m_reader.read(out);
+
+    if (not m_buf) {
+      auto const res = co_await fill();
+      if (not res)
+        co_return std::unexpected(res.error());
+    }
+
+    auto const in = buffered();
+    auto const len = std::min(in.size_bytes(), out.size_bytes());
+    std::memcpy(out.data(), in.data(), len);
+    consume(len);
+    co_return len;
+  }
+
+  /* returns the buffered bytes, reading more in only if there are none.
+   * an empty span means the reader has hit eof. the bytes are not
+   * consumed, and the span is valid until the next call on the reader */
+  Coro<IOResult<std::span<std::byte const>>> peek()
+  {
+    release_if_empty();
+
+    if (not m_buf) {
+      auto const res = co_await fill();
+      if (not res)
+        co_return std::unexpected(res.error());
+    }
+
+    co_return buffered();
+  }
+
+  /* reads up to & including the next delimiter, returning a view over
+   * it that stays valid until the next call on the reader. at eof the
+   * remaining bytes are returned without a delimiter, and then an empty
+   * span. if the buffer fills without a delimiter, ENOBUFS is returned
+   * and the buffered bytes are left in place. */
+  Coro<IOResult<std::span<std::byte const>>> read_until(std::byte delim)
+  {
+    release_if_empty();
+
+    unsigned scanned = 0;
+
+    for (;;) {
+      auto const in = buffered();
+      auto const found =
+        std::find(in.begin() + scanned, in.end(), delim) - in.begin();
+
+      if (unsigned(found) != in.size()) {
+        consume(found + 1);
+        co_return in.first(found + 1);
+      }
+
+      scanned = in.size();
+
+      if (m_buf && m_start == 0 && m_end == m_buf->size())
+        co_return std::unexpected(ENOBUFS);
+
+      auto const res = co_await fill();
+      if (not res)
+        co_return std::unexpected(res.error());
+
+      if (*res == 0) {
+        auto const rest = buffered();
+        consume(rest.size());
+        co_return rest;
+      }
+    }
+  }
+
+  /* fills the whole of out, unless eof is hit first.
+   * returns the number of bytes read */
+  Coro<IOResult<unsigned>> read_exact(std::span<std::byte> out)
+  {
+    unsigned idx = 0;
+
+    while (idx != out.size_bytes()) {
+      auto const res = co_await read(out.subspan(idx));
+      if (not res)
+        co_return std::unexpected(res.error());
+      if (*res == 0)
+        break;
+      idx += *res;
+    }
+
+    co_return idx;
+  }
+
+private:
+  void release_if_empty()
+  {
+    if (m_buf && m_start == m_end)
+      m_buf.reset(), m_start = m_end = 0;
+  }
+
+  /* moves any buffered bytes to the front of the buffer,
+   * then does a single read into the space behind them */
+  Coro<IOResult<unsigned>> fill()
+  {
+    if (not m_buf)
+      m_buf.emplace(m_pool.get());
+
+    if (m_start != 0) {
+      std::memmove(m_buf->data(), m_buf->data() + m_start, m_end - m_start);
+      m_end -= m_start;
+      m_start = 0;
+    }
+
+    auto res = co_await m_reader.read(
+      m_buf->span().subspan(m_end, m_buf->size() - m_end));
+
+    if (res)
+      m_end += *res;
+
+    co_return std::move(res);
+  }
+
+  R& m_reader;
+  BufferPool& m_pool;
+  std::optional<BufferPool::Buffer> m_buf;
+  unsigned m_start = 0;
+  unsigned m_end = 0;
+};
+
+/* buffered adapter over any AsyncWriter.
+ * small writes are coalesced in a pooled buffer until it fills or
+ * flush() is called, writes at least as large as the buffer are
+ * written straight through. dropping a BufWriter does NOT flush it.
+ * a BufWriter is itself an AsyncWriter. */
+template<AsyncWriter W>
+class BufWriter
+{
+public:
+  BufWriter(W& writer, BufferPool& pool = BufferPool::shared())
+    : m_writer(writer)
+    , m_pool(pool) {};
+
+  BufWriter(const BufWriter&) = delete;
+  BufWriter& operator=(const BufWriter&) = delete;
+
+  /* always takes the whole of in, unless an error occurs */
+  Coro<IOResult<unsigned>> write(std::span<std::byte const> in)
+  {
+    if (m_len + in.size_bytes() > m_pool.buffer_size()) {
+      auto const res = co_await flush();
+      if (not res)
+        co_return std::unexpected(res.error());
+    }
+
+    if (in.size_bytes() >= m_pool.buffer_size())
+      co_return co_await write_exact(m_writer, in);
+
+    if (not m_buf)
+      m_buf.emplace(m_pool.get());
+
+    std::memcpy(m_buf->data() + m_len, in.data(), in.size_bytes());
+    m_len += in.size_bytes();
+    co_return in.size_bytes();
+  }
+
+  /* writes out everything buffered, handing the buffer back to the pool */
+  Coro<IOResult<Empty>> flush()
+  {
+    if (m_len == 0)
+      co_return Empty{};
+
+    auto const res = co_await write_exact(
+      m_writer, std::span<std::byte const>(m_buf->data(), m_len));
+
+    if (not res)
+      co_return std::unexpected(res.error());
+
+    m_len = 0;
+    m_buf.reset();
+    co_return Empty{};
+  }
+
+  unsigned buffered() const { return m_len; }
+
+private:
+  W& m_writer;
+  BufferPool& m_pool;
+  std::optional<BufferPool::Buffer> m_buf;
+  unsigned m_len = 0;
+};
+
+};
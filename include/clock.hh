@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+namespace birdsong {
+
+/* coarse steady clock, cached per thread.
+ * runtime workers refresh it every time they resume a task, and the
+ * run loop every time the reactor wakes, so reading it on those threads
+ * is just a thread local load. threads that never refresh it fall
+ * through to the precise clock. timers & timeouts are measured with
+ * this, use precise() for anything that needs real resolution. */
+class CoarseClock
+{
+public:
+  using duration = std::chrono::steady_clock::duration;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::steady_clock::time_point;
+  constexpr static bool is_steady = true;
+
+  static time_point now()
+  {
+    if (s_cached == time_point{})
+      return precise();
+    return s_cached;
+  }
+
+  static time_point precise() { return std::chrono::steady_clock::now(); }
+
+  /* re-reads the precise clock into this threads cache */
+  static time_point refresh() { return s_cached = precise(); }
+
+  /* stops caching on this thread, until the next refresh */
+  static void invalidate() { s_cached = {}; }
+
+private:
+  static inline thread_local time_point s_cached{};
+};
+
+};
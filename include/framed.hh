@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "buffer.hh"
+#include "coro.hh"
+#include "io.hh"
+#include "runtime.hh"
+
+namespace birdsong {
+
+/* frames on the wire are a 4 byte big endian payload length,
+ * followed by the payload itself */
+constexpr unsigned FrameHeaderSize = 4;
+
+/* reads length prefixed frames off of any AsyncReader.
+ * frames are parsed in place out of a single buffer that each read
+ * fills as far as it can, so a burst of small frames costs one syscall
+ * and no copies. the buffer is only compacted when the frame at its
+ * tail would run off the end, so frames are always contiguous.
+ * like BufReader, the buffer is drawn from a pool and handed back
+ * once it is drained between calls. a read that has to wait for more
+ * bytes holds on to it whilst it waits, so a reader parked on a quiet
+ * connection still has a buffer of the class fitting buffer_size */
+template<AsyncReader R>
+class FramedReader
+{
+public:
+  /* the buffer always has room for at least one maximum sized frame */
+  FramedReader(R& reader,
+               unsigned max_frame = 1 << 16,
+               unsigned buffer_size = 1 << 16,
+               BufferPool& pool = BufferPool::shared())
+    : m_reader(reader)
+    , m_pool(pool)
+    , m_maxFrame(max_frame)
+    , m_size(std::max(buffer_size, max_frame + FrameHeaderSize)) {};
+
+  FramedReader(const FramedReader&) = delete;
+  FramedReader& operator=(const FramedReader&) = delete;
+
+  /* the payload of the next frame. the view is into the readers
+   * buffer, and is only valid until the next call to read.
+   * nullopt if the stream ended cleanly between frames.
+   * EMSGSIZE if the frame is over the maximum, and EPROTO if the
+   * stream ended part way through a frame */
+  Coro<IOResult<std::optional<std::span<std::byte const>>>> read()
+  {
+    for (;;) {
+      unsigned const avail = m_end - m_start;
+
+      /* bytes the frame at the front needs, as far as is known yet */
+      unsigned need = FrameHeaderSize;
+
+      if (avail >= FrameHeaderSize) {
+        std::uint32_t const len = parse_header(m_buf->data() + m_start);
+        if (len > m_maxFrame)
+          co_return std::unexpected(EMSGSIZE);
+
+        need += len;
+        if (avail >= need) {
+          auto const* payload = m_buf->data() + m_start + FrameHeaderSize;
+          m_start += need;
+          co_return std::span<std::byte const>(payload, len);
+        }
+      }
+
+      /* earlier frames handed out are only overwritten from here,
+       * once the caller has come back for the next one */
+      if (m_start == m_end)
+        m_buf.reset(), m_start = m_end = 0;
+      else if (m_start + need > m_buf->size())
+        compact();
+
+      if (not m_buf)
+        m_buf.emplace(m_pool.get(m_size));
+
+      auto const res = co_await m_reader.read(
+        m_buf->span().subspan(m_end, m_buf->size() - m_end));
+      if (not res)
+        co_return std::unexpected(res.error());
+
+      if (*res == 0) {
+        if (m_start == m_end)
+          co_return std::nullopt;
+        co_return std::unexpected(EPROTO);
+      }
+
+      m_end += *res;
+    }
+  }
+
+private:
+  static std::uint32_t parse_header(std::byte const* in)
+  {
+    return std::uint32_t(in[0]) << 24 | std::uint32_t(in[1]) << 16 |
+           std::uint32_t(in[2]) << 8 | std::uint32_t(in[3]);
+  }
+
+  void compact()
+  {
+    std::memmove(m_buf->data(), m_buf->data() + m_start, m_end - m_start);
+    m_end -= m_start;
+    m_start = 0;
+  }
+
+  R& m_reader;
+  BufferPool& m_pool;
+  unsigned const m_maxFrame;
+  unsigned const m_size;
+  std::optional<BufferPool::Buffer> m_buf;
+  unsigned m_start = 0;
+  unsigned m_end = 0;
+};
+
+/* writes length prefixed frames to any AsyncVectoredWriter.
+ * queued frames are not copied, each frame is written straight out of
+ * the callers buffer alongside its header, and everything queued is
+ * written by as few vectored writes as possible on flush.
+ * payloads must stay alive & unchanged until they have been flushed */
+template<AsyncVectoredWriter W>
+class FramedWriter
+{
+public:
+  FramedWriter(W& writer, unsigned max_frame = 1 << 16)
+    : m_writer(writer)
+    , m_maxFrame(max_frame) {};
+
+  FramedWriter(const FramedWriter&) = delete;
+  FramedWriter& operator=(const FramedWriter&) = delete;
+
+  /* adds a frame to the next flush. EMSGSIZE if it is over the maximum */
+  IOResult<Empty> queue(std::span<std::byte const> payload)
+  {
+    if (payload.size_bytes() > m_maxFrame)
+      return std::unexpected(EMSGSIZE);
+
+    std::uint32_t const len = payload.size_bytes();
+    m_pending.push_back({
+      { std::byte(len >> 24),
+        std::byte(len >> 16),
+        std::byte(len >> 8),
+        std::byte(len) },
+      payload,
+    });
+
+    return Empty{};
+  }
+
+  /* writes out every queued frame.
+   * EPIPE if the writer stopped accepting bytes before they all went */
+  Coro<IOResult<Empty>> flush()
+  {
+    if (m_pending.empty())
+      co_return Empty{};
+
+    /* built here rather than in queue(),
+     * as queuing may move the headers around */
+    m_bufs.clear();
+    std::size_t total = 0;
+    for (auto const& frame : m_pending) {
+      m_bufs.push_back(frame.header);
+      total += FrameHeaderSize + frame.payload.size_bytes();
+      if (not frame.payload.empty())
+        m_bufs.push_back(frame.payload);
+    }
+
+    auto rt = co_await GetRuntime();
+    auto const res = co_await write_all(*rt, m_writer, std::span(m_bufs));
+
+    m_pending.clear();
+    if (not res)
+      co_return std::unexpected(res.error());
+
+    /* the writer stopped taking bytes part way through */
+    if (*res != total)
+      co_return std::unexpected(EPIPE);
+
+    co_return Empty{};
+  }
+
+  /* queues a single frame and flushes it, along with anything
+   * else that had been queued */
+  Coro<IOResult<Empty>> write(std::span<std::byte const> payload)
+  {
+    if (auto const res = queue(payload); not res)
+      co_return std::unexpected(res.error());
+    co_return co_await flush();
+  }
+
+  unsigned queued() const { return m_pending.size(); }
+
+private:
+  struct Pending
+  {
+    std::array<std::byte, FrameHeaderSize> header;
+    std::span<std::byte const> payload;
+  };
+
+  W& m_writer;
+  unsigned const m_maxFrame;
+
+  /* kept between flushes so their capacity is reused */
+  std::vector<Pending> m_pending;
+  std::vector<std::span<std::byte const>> m_bufs;
+};
+
+};
@@ -2,9 +2,13 @@
 
 #include <concepts>
 #include <expected>
+#include <optional>
 #include <span>
+#include <sys/uio.h>
 
+#include "buffer.hh"
 #include "coro.hh"
+#include "reactor.hh"
 
 namespace birdsong {
 
@@ -13,6 +17,80 @@ using Errno = unsigned;
 template<typename T>
 using IOResult = std::expected<T, Errno>;
 
+/* suspends the task until the fd has any events within the mask.
+ * hangups & errors always wake the task, so an empty mask
+ * waits on just those. */
+class FDReady : public AwaitableBase
+{
+public:
+  FDReady(unsigned fd, Reactor::WaitMask mask)
+    : m_fd(fd)
+    , m_mask(mask) {};
+
+  void await_suspend(std::coroutine_handle<>);
+
+protected:
+  unsigned m_fd;
+  Reactor::WaitMask m_mask;
+};
+
+/* base for awaitables wrapping a single non-blocking syscall
+ * on a file descriptor. derived awaitables attempt the syscall
+ * inline from await_ready via settle(), and only if it would block
+ * is the task handed over to the reactor. once woken, the syscall
+ * is attempted exactly once more from await_resume. */
+class SpeculativeIO : public FDReady
+{
+public:
+  using FDReady::FDReady;
+
+protected:
+  /* records the return value of a raw syscall.
+   * returns false if the syscall would have blocked */
+  bool settle(long ret);
+
+  /* consumes the settled result. if the fd was woken
+   * spuriously and the retry would still block, EAGAIN is returned */
+  IOResult<unsigned> take();
+
+  std::optional<IOResult<unsigned>> m_result;
+};
+
+/* bytes read into a buffer borrowed from a pool.
+ * the buffer goes back to the pool once this is dropped */
+struct Borrowed
+{
+  BufferPool::Buffer buffer;
+  unsigned len;
+
+  std::span<std::byte const> bytes() const
+  {
+    return buffer.span().first(len);
+  }
+};
+
+/* reads from a socket into a buffer that is only borrowed from the pool
+ * once there is something to read, so a task waiting on an idle
+ * connection holds no buffer at all. a speculative read that would
+ * block hands its buffer straight back before suspending.
+ * eof is a Borrowed of length 0 */
+class BorrowedRead : public SpeculativeIO
+{
+public:
+  BorrowedRead(unsigned fd, BufferPool& pool)
+    : SpeculativeIO(fd, { true, false })
+    , m_pool(pool) {};
+
+  bool await_ready();
+  IOResult<Borrowed> await_resume();
+
+private:
+  long attempt();
+
+  BufferPool& m_pool;
+  std::optional<BufferPool::Buffer> m_buf;
+};
+
 template<typename T>
 concept AsyncWriter = requires(T t, std::span<std::byte const> buf) {
   { t.write(buf).await_resume() } -> std::same_as<IOResult<unsigned>>;
@@ -23,6 +101,38 @@ concept AsyncReader = requires(T t, std::span<std::byte> buf) {
   { t.read(buf).await_resume() } -> std::same_as<IOResult<unsigned>>;
 };
 
+/* scatter/gather variants, reading into or writing out of
+ * several buffers with a single syscall */
+template<typename T>
+concept AsyncVectoredWriter =
+  requires(T t, std::span<std::span<std::byte const> const> bufs) {
+    {
+      t.write_vectored(bufs).await_resume()
+    } -> std::same_as<IOResult<unsigned>>;
+  };
+
+template<typename T>
+concept AsyncVectoredReader =
+  requires(T t, std::span<std::span<std::byte> const> bufs) {
+    {
+      t.read_vectored(bufs).await_resume()
+    } -> std::same_as<IOResult<unsigned>>;
+  };
+
+/* most iovecs a vectored awaitable will hand to a single syscall.
+ * any buffers past this are left for the next call */
+constexpr unsigned MaxIOVecs = 64;
+
+/* fills out the iovec array from the list of buffers,
+ * returning the number of iovecs used */
+unsigned
+to_iovecs(std::span<std::span<std::byte> const>, std::span<iovec, MaxIOVecs>);
+unsigned
+to_iovecs(std::span<std::span<std::byte const> const>,
+          std::span<iovec, MaxIOVecs>);
+
+/* both of these stop short if the other end hits eof,
+ * returning how much was actually transferred */
 Coro<IOResult<unsigned>>
 write_all(Runtime&, AsyncWriter auto& writer, std::span<std::byte const> buf)
 {
@@ -39,7 +149,7 @@ write_all(Runtime&, AsyncWriter auto& writer, std::span<std::byte const> buf)
       co_return std::unexpected(res.error());
   } while (idx != buf.size_bytes());
 
-  co_return buf.size_bytes();
+  co_return idx;
 }
 
 Coro<IOResult<unsigned>>
@@ -58,7 +168,172 @@ read_all(Runtime&, AsyncReader auto& reader, std::span<std::byte> buf)
       co_return std::unexpected(res.error());
   } while (idx != buf.size_bytes());
 
-  co_return buf.size_bytes();
+  co_return idx;
+}
+
+/* read_all/write_all without the coroutine frame. the operation is
+ * retried inline for as long as it completes without blocking, which
+ * for small buffers is usually the whole transfer. only once it would
+ * block is a read_all/write_all started on the remainder. */
+template<AsyncReader R>
+class ReadExact : public AwaitableBase
+{
+public:
+  ReadExact(R& reader, std::span<std::byte> buf)
+    : m_reader(reader)
+    , m_buf(buf) {};
+
+  bool await_ready()
+  {
+    while (m_done != m_buf.size_bytes()) {
+      auto op = m_reader.read(m_buf.subspan(m_done));
+      if (not op.await_ready())
+        return false;
+
+      auto const res = op.await_resume();
+      if (not res)
+        return (m_error = res.error(), true);
+      if (*res == 0)
+        return true;
+
+      m_done += *res;
+    }
+
+    return true;
+  }
+
+  void await_suspend(std::coroutine_handle<> handle)
+  {
+    auto rt = basic_handle_from_void(handle).promise().runtime;
+    m_slow.emplace(read_all(*rt, m_reader, m_buf.subspan(m_done)));
+    m_slow->await_suspend(handle);
+  }
+
+  IOResult<unsigned> await_resume()
+  {
+    if (m_slow) {
+      auto const res = m_slow->await_resume();
+      if (not res)
+        return std::unexpected(res.error());
+      m_done += *res;
+    }
+
+    if (m_error)
+      return std::unexpected(*m_error);
+
+    return m_done;
+  }
+
+private:
+  R& m_reader;
+  std::span<std::byte> m_buf;
+  unsigned m_done = 0;
+  std::optional<unsigned> m_error;
+  std::optional<Coro<IOResult<unsigned>>> m_slow;
+};
+
+template<AsyncWriter W>
+class WriteExact : public AwaitableBase
+{
+public:
+  WriteExact(W& writer, std::span<std::byte const> buf)
+    : m_writer(writer)
+    , m_buf(buf) {};
+
+  bool await_ready()
+  {
+    while (m_done != m_buf.size_bytes()) {
+      auto op = m_writer.write(m_buf.subspan(m_done));
+      if (not op.await_ready())
+        return false;
+
+      auto const res = op.await_resume();
+      if (not res)
+        return (m_error = res.error(), true);
+      if (*res == 0)
+        return true;
+
+      m_done += *res;
+    }
+
+    return true;
+  }
+
+  void await_suspend(std::coroutine_handle<> handle)
+  {
+    auto rt = basic_handle_from_void(handle).promise().runtime;
+    m_slow.emplace(write_all(*rt, m_writer, m_buf.subspan(m_done)));
+    m_slow->await_suspend(handle);
+  }
+
+  IOResult<unsigned> await_resume()
+  {
+    if (m_slow) {
+      auto const res = m_slow->await_resume();
+      if (not res)
+        return std::unexpected(res.error());
+      m_done += *res;
+    }
+
+    if (m_error)
+      return std::unexpected(*m_error);
+
+    return m_done;
+  }
+
+private:
+  W& m_writer;
+  std::span<std::byte const> m_buf;
+  unsigned m_done = 0;
+  std::optional<unsigned> m_error;
+  std::optional<Coro<IOResult<unsigned>>> m_slow;
+};
+
+template<AsyncReader R>
+ReadExact<R>
+read_exact(R& reader, std::span<std::byte> buf)
+{
+  return ReadExact<R>(reader, buf);
+}
+
+template<AsyncWriter W>
+WriteExact<W>
+write_exact(W& writer, std::span<std::byte const> buf)
+{
+  return WriteExact<W>(writer, buf);
+}
+
+/* writes every buffer in the list, resuming the vectored write
+ * wherever a partial write left off. the list itself is consumed
+ * in place, so its contents are unspecified afterwards */
+Coro<IOResult<unsigned>>
+write_all(Runtime&,
+          AsyncVectoredWriter auto& writer,
+          std::span<std::span<std::byte const>> bufs)
+{
+  unsigned total = 0;
+
+  while (not bufs.empty()) {
+    auto const res = co_await writer.write_vectored(bufs);
+    if (not res)
+      co_return std::unexpected(res.error());
+    if (*res == 0)
+      break;
+
+    total += *res;
+
+    /* drop every fully written buffer, then trim the partial one */
+    unsigned left = *res;
+    while (not bufs.empty() && left >= bufs.front().size_bytes()) {
+      left -= bufs.front().size_bytes();
+      bufs = bufs.subspan(1);
+    }
+
+    if (left != 0)
+      bufs.front() = bufs.front().subspan(left);
+  }
+
+  co_return total;
 }
 
 };
@@ -10,6 +10,10 @@ public:
   std::strong_ordering operator<=>(IPAddr const& rhs) const;
   unsigned char operator[](int i) const;
 
+  /* both in host byte order */
+  unsigned addr() const { return m_val; }
+  unsigned short port() const { return m_port; }
+
 private:
   unsigned m_val;
   unsigned short m_port;
@@ -38,10 +38,17 @@ public:
   virtual ~Reactor() = default;
 
   virtual void insert(FDWait) = 0;
-  virtual void poll() = 0;
+
+  /* waits up to timeout_ms for events, waking any ready tasks.
+   * the wait must end early if insert() or interrupt() is called
+   * from another thread in the meantime. */
+  virtual void poll(unsigned timeout_ms) = 0;
+
+  /* makes the current or next call to poll return immediately */
+  virtual void interrupt() = 0;
 };
 
-class PollReactor : public Reactor
+class PollReactor final : public Reactor
 {
   /* TODO: every once in a while check if any of the
    * inserted wakers/tasks have been killed.
@@ -54,7 +61,8 @@ public:
   ~PollReactor();
 
   void insert(FDWait) override;
-  void poll() override;
+  void poll(unsigned timeout_ms) override;
+  void interrupt() override;
 
   Data& get_data(Atom::Key) { return *m_data; }
 
@@ -62,4 +70,9 @@ private:
   std::unique_ptr<Data> m_data;
 };
 
+/* the reactor the runtime knows about at compile time.
+ * runtimes that use it call straight into it, any other
+ * reactor is called through the vtable */
+using NativeReactor = PollReactor;
+
 };
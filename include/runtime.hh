@@ -9,6 +9,7 @@
 #include "reactor.hh"
 #include "task.hh"
 #include "thread_queue.hh"
+#include "timer.hh"
 
 namespace birdsong {
 
@@ -39,7 +40,8 @@ class Runtime : public Atom
 public:
   struct Config
   {
-    /* ms between non-blocking poll invocations */
+    /* longest the reactor may block for in one poll.
+     * bounds how long the run loop takes to notice all tasks ending */
     unsigned poll_ms_wait = 10;
   };
 
@@ -61,7 +63,7 @@ public:
     Waker waker = spawn_internal<T>(std::move(coro));
     auto out = JoinHandle<T>(*this, *waker.acquire()->get());
     waker.wake();
-    return std::move(out);
+    return out;
   }
 
   auto spawn_lambda(auto const& lambda)
@@ -98,10 +100,63 @@ public:
    * panics if called from outside of a runtimes thread */
   Waker create_waker();
   Task& current_task();
+
+  /* whilst a race is open, every waker created for the current
+   * task shares it with the race rather than owning it outright,
+   * and only the first of them to be woken will resume the task.
+   * used to wait on several wake sources, such as an fd & a timer. */
+  void open_race();
+
+  /* stops handing out racing wakers on this thread. if the task
+   * did not end up suspending, it is taken back from the race */
+  std::shared_ptr<WakeRace> close_race(bool suspended);
   unsigned num_tasks();
 
   Reactor& get_reactor() { return *m_reactor; }
 
+  /* io awaitables should go through these rather than get_reactor().
+   * rather than templating the runtime, and every awaitable with it,
+   * on the reactor type, the reactor is only known at compile time as
+   * the final NativeReactor. when the runtime was built with one, these
+   * branch on it & call it directly, which only saves the virtual
+   * dispatch, its bodies live in reactor.cc and aren't inlined.
+   * any other reactor is still called through the vtable */
+  void reactor_insert(Reactor::FDWait wait)
+  {
+    if (m_nativeReactor)
+      m_nativeReactor->insert(std::move(wait));
+    else
+      m_reactor->insert(std::move(wait));
+  }
+
+  void reactor_poll(unsigned timeout_ms)
+  {
+    if (m_nativeReactor)
+      m_nativeReactor->poll(timeout_ms);
+    else
+      m_reactor->poll(timeout_ms);
+  }
+
+  void reactor_interrupt()
+  {
+    if (m_nativeReactor)
+      m_nativeReactor->interrupt();
+    else
+      m_reactor->interrupt();
+  }
+
+  TimerWheel& timers() { return m_timers; }
+
+  /* arms a timer on this runtimes wheel,
+   * interrupting the reactor if the timer is due before it next wakes */
+  void timer_insert(TimerWheel::Entry& entry,
+                    TimerWheel::Clock::time_point deadline,
+                    Waker waker)
+  {
+    if (m_timers.insert(entry, deadline, std::move(waker)))
+      reactor_interrupt();
+  }
+
 private:
   template<typename T>
   Waker spawn_internal(CoroBase coro)
@@ -116,6 +171,12 @@ private:
 
   std::unique_ptr<Data> m_data;
   std::unique_ptr<Reactor> m_reactor;
+
+  /* non-owning, set when m_reactor is a NativeReactor */
+  NativeReactor* m_nativeReactor;
+
+  TimerWheel m_timers;
+
   // std::unique_ptr<AtomicData> m_atomicData;
   ThreadQueue m_threadQueue;
 };
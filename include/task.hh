@@ -3,10 +3,13 @@
 #include <concepts>
 #include <list>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include "atomic.hh"
 #include "common.hh"
 #include "coro.hh"
+#include "thread_queue.hh"
 
 namespace birdsong {
 
@@ -25,10 +28,31 @@ concept Cancellable = requires(Awaitable t) {
   { t.cancel() };
 };
 
+/* shared by every waker of a task that is waiting on several
+ * wake sources at once, see Runtime::open_race.
+ * whichever waker fires first takes the task,
+ * waking any of the others afterwards does nothing */
+struct WakeRace
+{
+  Mutex mutex;
+  std::unique_ptr<Task> task;
+
+  /* id of the waker that took the task, -1u if none has yet */
+  unsigned winner{ -1u };
+  unsigned next_id{ 0 };
+
+  bool won_by(unsigned id)
+  {
+    MutexLock lock(mutex);
+    return winner == id;
+  }
+};
+
 class Waker : public Atom
 {
 public:
   Waker(Runtime& runtime, std::unique_ptr<Task> task);
+  Waker(Runtime& runtime, std::shared_ptr<WakeRace> race, unsigned id);
   Waker(Waker&&);
 
   /* NOTE: will attempt to lock the task it owns!
@@ -36,13 +60,32 @@ public:
    * make sure you drop em before calling wake */
   void wake();
 
+  /* wakes every waker in the list, handing all of the woken tasks
+   * to the scheduler in one go. the list is emptied afterwards.
+   * same locking caveats as wake() apply to every waker. */
+  static void wake_all(std::vector<Waker>&);
+
+  /* true if waking would do nothing useful, either because
+   * the task was killed or another waker in its race won */
+  bool defunct();
+
+  /* id of this waker within its race, -1u if not racing */
+  unsigned race_id() const { return m_raceId; }
+
   using Data = std::unique_ptr<Task>;
   Data& get_data(Atom::Key) { return task; }
 
 private:
+  /* takes the task out of this waker and packages it
+   * into a job that resumes it on a scheduler thread */
+  std::optional<ThreadQueue::Job> take_job();
+
   /* TODO: i can probably use a memory pool for tasks */
   Runtime& runtime;
   Data task;
+
+  std::shared_ptr<WakeRace> m_race;
+  unsigned m_raceId{ -1u };
 };
 
 struct SharedTaskState
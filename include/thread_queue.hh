@@ -25,7 +25,10 @@ public:
   constexpr static unsigned MainThread = -1u;
   static unsigned GetThisThreadID();
 
-  ThreadQueue(unsigned num_workers = std::thread::hardware_concurrency());
+  /* workers are numbered from first_id. queues whose threads
+   * may share locks with each other need disjoint ids */
+  ThreadQueue(unsigned num_workers = std::thread::hardware_concurrency(),
+              ThreadID first_id = 0);
   ~ThreadQueue();
 
   ThreadQueue(const ThreadQueue&) = delete;
@@ -37,6 +40,10 @@ public:
   ThreadQueue& operator+=(Job&&);
   void push_task(Job&&);
 
+  /* pushes every job under a single lock acquisition,
+   * waking at most one idle worker per job */
+  void push_tasks(std::vector<Job>&&);
+
   bool quitting() const { return m_taskQueueQuit; }
 
 private:
@@ -44,6 +51,10 @@ private:
   std::mutex m_taskQueueMutex;
   std::queue<Job*> m_taskQueue;
   std::atomic<int> m_numWorking;
+
+  /* number of workers blocked on taskQueueNotify.
+   * only read or written with taskQueueMutex held */
+  unsigned m_numIdle{ 0 };
   std::vector<std::pair<std::thread, Worker*>> m_threads;
 
   /* if true, the next time taskQueueNotify is triggered
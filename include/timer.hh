@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "atomic.hh"
+#include "clock.hh"
+#include "task.hh"
+
+namespace birdsong {
+
+/* hierarchical hashed timer wheel, owned by the runtime.
+ * timers are kept at 1ms resolution across 4 levels of 64 slots,
+ * covering a bit over 4 hours before entries have to be cascaded
+ * more than once. inserting & cancelling are O(1), and advancing
+ * the wheel hands back every expired waker in a single batch.
+ * the wheel never spawns threads, the runtime drives it
+ * from the reactors poll timeout. */
+class TimerWheel : public Atom
+{
+public:
+  /* timers are armed & expired against the coarse clock, it shares
+   * its time points with std::chrono::steady_clock */
+  using Clock = CoarseClock;
+
+  /* intrusive timer entry, owned by whatever is waiting on it.
+   * an entry must be cancelled before it is destroyed */
+  class Entry
+  {
+    friend class TimerWheel;
+
+  public:
+    Entry() = default;
+    Entry(const Entry&) = delete;
+    Entry(Entry&&) = delete;
+    Entry& operator=(const Entry&) = delete;
+    Entry& operator=(Entry&&) = delete;
+
+  private:
+    Entry* prev = nullptr;
+    Entry* next = nullptr;
+
+    /* absolute deadline in wheel ticks */
+    std::uint64_t deadline = 0;
+
+    /* flattened level/slot index of the list the entry is linked in.
+     * -1u if the entry is not currently linked */
+    unsigned slot = -1u;
+
+    std::optional<Waker> waker;
+  };
+
+  struct Data;
+
+  TimerWheel();
+  ~TimerWheel();
+
+  /* arms the entry to wake the waker once the deadline has passed.
+   * deadlines already in the past are fired on the next advance.
+   * returns true if the deadline is earlier than the time the
+   * wheel will next be advanced at, meaning the driver has to be
+   * interrupted for the timer to be on time. */
+  bool insert(Entry&, Clock::time_point deadline, Waker);
+
+  /* disarms the entry, returning its waker if it had not yet fired */
+  std::optional<Waker> cancel(Entry&);
+
+  /* true if the entry is armed and hasnt fired yet */
+  bool pending(Entry&);
+
+  /* fires every entry whose deadline is at or before now,
+   * appending their wakers to the list */
+  void advance(Clock::time_point now, std::vector<Waker>& expired);
+
+  /* ms until the wheel next needs to be advanced, capped at max_ms.
+   * the returned time is recorded, see insert(). */
+  unsigned next_timeout(unsigned max_ms);
+
+  Data& get_data(Atom::Key) { return *m_data; }
+
+private:
+  std::unique_ptr<Data> m_data;
+};
+
+};
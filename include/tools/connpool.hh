@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "../atomic.hh"
+#include "../clock.hh"
+#include "../common.hh"
+#include "../coro.hh"
+#include "../io.hh"
+#include "../net.hh"
+#include "../task.hh"
+#include "sockopt.hh"
+#include "tcp.hh"
+
+namespace birdsong {
+
+/* pool of outbound tcp connections, keyed by the address they go to.
+ * checking out hands back an idle connection to the host if there is a
+ * healthy one, otherwise connects a new one. once a host has max_per_host
+ * connections open, checkouts queue until one is handed back.
+ * the pool must outlive every lease taken from it. */
+class ConnectionPool : public Atom
+{
+  struct Idle
+  {
+    TCPSocket socket;
+    CoarseClock::time_point since;
+  };
+
+  struct Host
+  {
+    /* most recently returned last, so the warmest connection
+     * is reused first and the oldest are evicted first */
+    std::vector<Idle> idle;
+
+    /* connections that are leased out or still connecting */
+    unsigned active = 0;
+
+    std::deque<Waker> waiting;
+  };
+
+  /* waits for a host to have a free slot or an idle connection */
+  struct WaitForSlot : AwaitableBase
+  {
+    WaitForSlot(ConnectionPool& pool, IPAddr addr)
+      : pool(pool)
+      , addr(addr) {};
+
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<>);
+    void await_resume() {};
+
+    ConnectionPool& pool;
+    IPAddr addr;
+  };
+
+public:
+  struct Config
+  {
+    unsigned max_per_host = 16;
+
+    /* idle connections older than this are closed
+     * rather than being handed back out */
+    std::chrono::milliseconds idle_timeout{ 30'000 };
+
+    SocketProfile profile{};
+  };
+
+  /* a checked out connection. handed back to the pool when dropped */
+  class Lease
+  {
+  public:
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    Lease(Lease&&);
+    Lease& operator=(Lease&&);
+    ~Lease();
+
+    TCPSocket& operator*() { return *m_socket; }
+    TCPSocket* operator->() { return &*m_socket; }
+
+    /* closes the connection instead of handing it back, such as after an
+     * error or when the protocol leaves the connection in an unknown state */
+    void discard();
+
+  private:
+    friend class ConnectionPool;
+    Lease(ConnectionPool& pool, IPAddr addr, TCPSocket socket);
+
+    ConnectionPool* m_pool;
+    IPAddr m_addr;
+    std::optional<TCPSocket> m_socket;
+  };
+
+  struct Data
+  {
+    std::map<IPAddr, Host> hosts;
+  };
+
+  ConnectionPool();
+  ConnectionPool(Config config);
+
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+  /* the errno of a failed connect isn't recoverable,
+   * so a connection that couldn't be made is reported as ECONNREFUSED */
+  Coro<IOResult<Lease>> checkout(IPAddr);
+
+  /* closes every idle connection past the idle timeout. checkouts do
+   * this for their own host, call this periodically to reap the rest */
+  void evict_idle();
+
+  Data& get_data(Atom::Key) { return m_data; }
+
+private:
+  enum class Claim
+  {
+    Idle,
+    Slot,
+    Full,
+  };
+
+  /* moves idle connections returned before the cutoff into expired */
+  static void evict_stale(Host&,
+                          CoarseClock::time_point cutoff,
+                          std::vector<Idle>& expired);
+
+  /* takes an idle connection or reserves a slot to connect into */
+  Claim claim(IPAddr, std::optional<TCPSocket>& idle);
+
+  /* gives up a slot, handing it to the next waiting checkout */
+  void release(IPAddr, std::optional<TCPSocket> socket);
+
+  Config const m_config;
+  Data m_data;
+};
+
+};
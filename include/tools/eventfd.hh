@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../common.hh"
+#include "../io.hh"
+
+namespace birdsong {
+
+/* kernel counter that tasks can wait on through the reactor.
+ * signalling it is a single write(2) that needs no runtime, so any
+ * thread, or another process holding the fd, can wake a task with it.
+ * signals are coalesced, however many land before the waiter runs
+ * it only wakes once & is handed their sum. the fd can also be
+ * registered in any other event loop. */
+class EventFd
+{
+  struct Wait : SpeculativeIO
+  {
+    Wait(EventFd& event)
+      : SpeculativeIO(event.m_fd, { true, false }) {};
+
+    bool await_ready();
+    IOResult<std::uint64_t> await_resume();
+
+    long attempt();
+    std::uint64_t value = 0;
+  };
+
+public:
+  ~EventFd();
+
+  EventFd(const EventFd&) = delete;
+  EventFd& operator=(const EventFd&) = delete;
+
+  EventFd(EventFd&&);
+  EventFd& operator=(EventFd&&);
+
+  /* in semaphore mode each wait takes 1 off of the counter,
+   * rather than taking the whole count */
+  static IOResult<EventFd> create(std::uint64_t initial = 0,
+                                  bool semaphore = false);
+
+  /* adds to the counter, waking whatever is waiting on it */
+  IOResult<Empty> signal(std::uint64_t n = 1);
+
+  /* waits for the counter to be non-zero, then takes from it */
+  Wait wait();
+
+  unsigned fd() const { return m_fd; }
+
+private:
+  explicit EventFd(unsigned fd)
+    : m_fd(fd) {};
+
+  unsigned m_fd = -1u;
+};
+
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <span>
+#include <string>
+#include <sys/types.h>
+
+#include "../blocking.hh"
+#include "../common.hh"
+#include "../io.hh"
+
+namespace birdsong {
+
+/* regular file whose syscalls run on the blocking pool.
+ * files always poll as ready, so unlike sockets they can't be waited
+ * on through the reactor, and a read that misses the page cache would
+ * otherwise stall the whole worker. each call is a single positional
+ * syscall, so any number of reads & writes at explicit offsets may be
+ * in flight on the same file at once.
+ * read() & write() go through a shared cursor so the file satisfies
+ * AsyncReader/AsyncWriter, only one of those may be in flight at once. */
+class AsyncFile
+{
+  struct Open
+  {
+    IOResult<AsyncFile> operator()() const;
+
+    std::string path;
+    int flags;
+    mode_t mode;
+  };
+
+  struct ReadAt
+  {
+    IOResult<unsigned> operator()() const;
+
+    unsigned fd;
+    std::span<std::byte> buf;
+    off_t offset;
+
+    /* if set, offset is ignored & the cursor is read and advanced */
+    off_t* cursor = nullptr;
+  };
+
+  struct WriteAt
+  {
+    IOResult<unsigned> operator()() const;
+
+    unsigned fd;
+    std::span<std::byte const> buf;
+    off_t offset;
+    off_t* cursor = nullptr;
+  };
+
+  struct Sync
+  {
+    IOResult<Empty> operator()() const;
+
+    unsigned fd;
+    bool data_only;
+  };
+
+  struct Allocate
+  {
+    IOResult<Empty> operator()() const;
+
+    unsigned fd;
+    int mode;
+    off_t offset;
+    off_t len;
+  };
+
+public:
+  explicit AsyncFile(unsigned fd);
+  ~AsyncFile();
+
+  AsyncFile(const AsyncFile&) = delete;
+  AsyncFile& operator=(const AsyncFile&) = delete;
+
+  AsyncFile(AsyncFile&&);
+  AsyncFile& operator=(AsyncFile&&);
+
+  /* opening can block on the filesystem too, so it goes through the pool */
+  static Blocking<Open> open(std::string path,
+                             int flags = O_RDONLY,
+                             mode_t mode = 0644);
+
+  Blocking<ReadAt> read_at(std::span<std::byte> buf, off_t offset);
+  Blocking<WriteAt> write_at(std::span<std::byte const> buf, off_t offset);
+
+  Blocking<ReadAt> read(std::span<std::byte> buf);
+  Blocking<WriteAt> write(std::span<std::byte const> buf);
+
+  /* flushes file data & metadata, or just the data if data_only */
+  Blocking<Sync> fsync(bool data_only = false);
+
+  /* reserves or manipulates disk space, mode is as for fallocate(2) */
+  Blocking<Allocate> fallocate(off_t offset, off_t len, int mode = 0);
+
+  unsigned fd() const { return m_fd; }
+
+private:
+  unsigned m_fd = -1u;
+  off_t m_cursor = 0;
+};
+
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+
+#include "../common.hh"
+#include "../task.hh"
+#include "../timer.hh"
+
+namespace birdsong {
+
+/* periodic ticker driven by the runtimes timer wheel.
+ * each co_await of an interval resumes at its next tick, and evaluates
+ * to the time the tick was scheduled for. ticks are computed from
+ * absolute deadlines, so the period doesn't drift no matter how late
+ * the awaiting task gets around to the next await.
+ * the first tick is one period after construction. */
+class Interval : public AwaitableBase
+{
+public:
+  /* what to do when the awaiting task falls behind by more
+   * than a whole period and ticks have been missed */
+  enum class MissedTick
+  {
+    /* fire every missed tick back to back until caught up */
+    Burst,
+    /* fire once, then restart the schedule a period from now */
+    Delay,
+    /* fire once, then continue on the original schedule,
+     * skipping any ticks that were missed */
+    Skip,
+  };
+
+  Interval(const Interval&) = delete;
+  Interval(Interval&&) = delete;
+  Interval& operator=(const Interval&) = delete;
+  Interval& operator=(Interval&&) = delete;
+
+  /* a period of 0 is clamped to 1ms, the resolution of the timer wheel */
+  Interval(unsigned ms, MissedTick policy = MissedTick::Burst);
+  ~Interval();
+
+  /* restarts the schedule, the next tick being one period from now */
+  void reset();
+
+  bool await_ready();
+  bool await_suspend(std::coroutine_handle<>);
+  TimerWheel::Clock::time_point await_resume();
+
+private:
+  TimerWheel::Clock::duration m_period;
+  TimerWheel::Clock::time_point m_next;
+  MissedTick m_policy;
+  TimerWheel::Entry m_entry;
+
+  /* runtime whose wheel the entry was last inserted in */
+  Runtime* m_runtime = nullptr;
+};
+
+};
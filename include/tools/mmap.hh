@@ -0,0 +1,91 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "../blocking.hh"
+#include "../common.hh"
+#include "../io.hh"
+
+namespace birdsong {
+
+/* read only file mapped into memory, for read mostly data that would
+ * otherwise be copied into buffers. views are handed out straight over
+ * the mapping, but touching a page that isn't resident faults & blocks
+ * the thread on disk, so cold ranges should be prefetched first.
+ * read() goes through a cursor so the file satisfies AsyncReader,
+ * only one read may be in flight at once. */
+class MappedFile
+{
+  struct Open
+  {
+    IOResult<MappedFile> operator()() const;
+
+    std::string path;
+  };
+
+  struct Prefetch
+  {
+    IOResult<Empty> operator()() const;
+
+    std::span<std::byte const> range;
+  };
+
+  /* copies inline if every page it touches is already resident,
+   * otherwise the copy is done from the blocking pool */
+  struct Read : AwaitableBase
+  {
+    Read(MappedFile& file, std::span<std::byte> buf)
+      : file(file)
+      , buf(buf) {};
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<>);
+    IOResult<unsigned> await_resume() { return m_copied; }
+
+    MappedFile& file;
+    std::span<std::byte> buf;
+    unsigned m_copied = 0;
+  };
+
+public:
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&&);
+  MappedFile& operator=(MappedFile&&);
+
+  static Blocking<Open> open(std::string path);
+
+  /* the whole mapping */
+  std::span<std::byte const> bytes() const { return { m_data, m_size }; }
+
+  /* a view over part of the mapping, clamped to its end */
+  std::span<std::byte const> view(std::size_t offset, std::size_t len) const;
+
+  /* faults in every page of the range from the blocking pool,
+   * resuming once they are all resident */
+  Blocking<Prefetch> prefetch(std::size_t offset, std::size_t len);
+
+  Read read(std::span<std::byte> buf);
+
+  std::size_t size() const { return m_size; }
+
+private:
+  MappedFile(std::byte const* data, std::size_t size)
+    : m_data(data)
+    , m_size(size) {};
+
+  /* copies from the cursor onwards, returning the number of bytes */
+  unsigned copy_out(std::span<std::byte>);
+
+  std::byte const* m_data = nullptr;
+  std::size_t m_size = 0;
+  std::size_t m_cursor = 0;
+};
+
+};
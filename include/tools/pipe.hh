@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "../common.hh"
+#include "../io.hh"
+
+namespace birdsong {
+
+/* non-blocking kernel pipe, both ends held by the one object.
+ * reads & writes satisfy AsyncReader/AsyncWriter, and the splice
+ * awaitables move bytes between the pipe and another fd without
+ * them ever being copied into userspace. the raw fds can be handed to
+ * another process or event loop, or to splice/tee/vmsplice directly. */
+class Pipe
+{
+  struct Read : SpeculativeIO
+  {
+    Read(Pipe& pipe, std::span<std::byte> buf)
+      : SpeculativeIO(pipe.m_fds[0], { true, false })
+      , buf(buf) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::byte> buf;
+  };
+
+  struct Write : SpeculativeIO
+  {
+    Write(Pipe& pipe, std::span<std::byte const> buf)
+      : SpeculativeIO(pipe.m_fds[1], { false, true })
+      , buf(buf) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::byte const> buf;
+  };
+
+  /* a splice can block on either end. when it does, the fd waited on is
+   * picked by whether it was the pipe or the other fd that wasn't ready */
+  struct Splice : SpeculativeIO
+  {
+    Splice(Pipe& pipe, unsigned other, std::size_t len, bool into_pipe);
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    Pipe& pipe;
+    unsigned other;
+    std::size_t len;
+    bool into_pipe;
+  };
+
+public:
+  ~Pipe();
+
+  Pipe(const Pipe&) = delete;
+  Pipe& operator=(const Pipe&) = delete;
+
+  Pipe(Pipe&&);
+  Pipe& operator=(Pipe&&);
+
+  static IOResult<Pipe> create();
+
+  Read read(std::span<std::byte> buf);
+  Write write(std::span<std::byte const> buf);
+
+  /* moves up to len bytes from fd into the pipe */
+  Splice splice_from(unsigned fd, std::size_t len);
+
+  /* moves up to len bytes out of the pipe into fd */
+  Splice splice_to(unsigned fd, std::size_t len);
+
+  /* resizes the pipes buffer, see F_SETPIPE_SZ */
+  IOResult<Empty> set_capacity(unsigned bytes);
+  unsigned capacity() const { return m_capacity; }
+
+  /* closes the write end, so the reader sees eof
+   * once everything already in the pipe has been read */
+  void close_write();
+
+  unsigned read_fd() const { return m_fds[0]; }
+  unsigned write_fd() const { return m_fds[1]; }
+
+private:
+  Pipe(int read_fd, int write_fd);
+
+  int m_fds[2] = { -1, -1 };
+  unsigned m_capacity = 0;
+};
+
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "../buffer.hh"
+#include "../coro.hh"
+#include "../io.hh"
+#include "splice.hh"
+#include "tcp.hh"
+
+namespace birdsong {
+
+struct ProxyConfig
+{
+  /* the proxy fails with ETIMEDOUT once neither direction has moved
+   * any bytes for this long. zero never times out */
+  std::chrono::milliseconds idle_timeout{ 0 };
+
+  /* move bytes through a kernel pipe rather than userspace buffers.
+   * if the sockets can't be spliced, buffers are fallen back to anyway */
+  bool use_splice = true;
+
+  /* buffers for the userspace path, the shared pool if unset */
+  BufferPool* pool = nullptr;
+};
+
+/* bytes moved so far, readable whilst the proxy is running */
+struct ProxyStats
+{
+  std::atomic<std::uint64_t> a_to_b{ 0 };
+  std::atomic<std::uint64_t> b_to_a{ 0 };
+};
+
+/* forwards bytes both ways between the two sockets until both have
+ * reached eof. eof on one socket is passed on by shutting down the write
+ * side of the other, so half closed connections keep working. each
+ * direction only reads once the last chunk it read has been written out,
+ * so a slow peer holds back the fast one rather than the proxy buffering
+ * for it. an error or idle timeout shuts both sockets down entirely. */
+Coro<IOResult<Transferred>>
+proxy(TCPSocket& a,
+      TCPSocket& b,
+      ProxyConfig const& config = {},
+      ProxyStats* stats = nullptr);
+
+};
@@ -2,13 +2,13 @@
 
 #include "../common.hh"
 #include "../task.hh"
-#include <condition_variable>
-#include <memory>
-#include <thread>
+#include "../timer.hh"
 
 namespace birdsong {
 
-/* starts the sleep thread immediately upon construction */
+/* starts counting down immediately upon construction.
+ * the sleep is registered on the runtimes timer wheel
+ * the first time it is awaited, no threads are involved */
 class Sleep : public AwaitableBase
 {
 public:
@@ -20,27 +20,19 @@ public:
   Sleep(unsigned ms);
   ~Sleep();
 
+  /* restarts the countdown from now. if a task is currently
+   * waiting on this sleep, it is kept waiting for the new duration */
   void reset(unsigned ms);
+
+  bool await_ready();
   bool await_suspend(std::coroutine_handle<>);
 
 private:
-  struct Data
-  {
-    struct Data2
-    {
-      std::optional<Waker> waker;
-      bool done{ false };
-    };
-
-    MutexWrapper<Data2> waker;
-    std::mutex flag_mutex;
-    std::condition_variable flag;
-    std::atomic<unsigned> ms;
-    bool deleting{ false };
-  };
-
-  std::thread sleep_thread;
-  Data* data;
+  TimerWheel::Clock::time_point m_deadline;
+  TimerWheel::Entry m_entry;
+
+  /* runtime whose wheel the entry was last inserted in */
+  Runtime* m_runtime = nullptr;
 };
 
 };
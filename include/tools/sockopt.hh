@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cerrno>
+#include <expected>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <sys/socket.h>
+
+#include "../common.hh"
+#include "../io.hh"
+
+namespace birdsong {
+
+/* a socket option, tagged with its level, name & value type
+ * so that it can't be set with the wrong sized value */
+template<int Level, int Name, typename T>
+struct SocketOption
+{
+  using Value = T;
+  static constexpr int level = Level;
+  static constexpr int name = Name;
+};
+
+namespace sockopt {
+
+/* disables nagle, small writes go out immediately */
+using NoDelay = SocketOption<IPPROTO_TCP, TCP_NODELAY, bool>;
+
+/* acks are sent immediately rather than delayed.
+ * the kernel may drop back out of quickack mode on its own,
+ * so this is usually re-applied after reads */
+using QuickAck = SocketOption<IPPROTO_TCP, TCP_QUICKACK, bool>;
+
+/* in bytes. the kernel doubles the value for bookkeeping */
+using SendBuffer = SocketOption<SOL_SOCKET, SO_SNDBUF, int>;
+using RecvBuffer = SocketOption<SOL_SOCKET, SO_RCVBUF, int>;
+
+/* holds back partial frames until uncorked or a full frame is queued */
+using Cork = SocketOption<IPPROTO_TCP, TCP_CORK, bool>;
+
+/* microseconds to busy poll the device queue for on blocking reads.
+ * raising it above net.core.busy_read needs CAP_NET_ADMIN */
+using BusyPoll = SocketOption<SOL_SOCKET, SO_BUSY_POLL, int>;
+
+/* listener only, seconds to hold an accept back until data arrives */
+using DeferAccept = SocketOption<IPPROTO_TCP, TCP_DEFER_ACCEPT, int>;
+
+};
+
+template<typename Opt>
+IOResult<Empty>
+set_option(unsigned fd, typename Opt::Value value)
+{
+  int val = value;
+  if (setsockopt(fd, Opt::level, Opt::name, &val, sizeof val) < 0)
+    return std::unexpected(errno);
+  return Empty{};
+}
+
+template<typename Opt>
+IOResult<typename Opt::Value>
+get_option(unsigned fd)
+{
+  int val = 0;
+  socklen_t len = sizeof val;
+  if (getsockopt(fd, Opt::level, Opt::name, &val, &len) < 0)
+    return std::unexpected(errno);
+  return typename Opt::Value(val);
+}
+
+/* set of options applied to every socket a listener accepts, or to a
+ * socket being connected. unset options are left at the kernels
+ * defaults. the presets trade latency against throughput */
+struct SocketProfile
+{
+  std::optional<bool> no_delay;
+  std::optional<bool> quick_ack;
+  std::optional<int> send_buffer;
+  std::optional<int> recv_buffer;
+  std::optional<bool> cork;
+  std::optional<int> busy_poll_us;
+  std::optional<int> defer_accept_s;
+
+  /* nodelay & quickack, with a short busy poll */
+  static SocketProfile low_latency();
+
+  /* large buffers, nagle left on */
+  static SocketProfile throughput();
+
+  /* applies the per connection options, stopping at the first failure.
+   * buffer sizes are best applied before connecting, so that the
+   * window scale is negotiated for them */
+  IOResult<Empty> apply(unsigned fd) const;
+
+  /* applies the options that only mean anything on a listening socket,
+   * along with the buffer sizes, which accepted sockets inherit */
+  IOResult<Empty> apply_listener(unsigned fd) const;
+};
+
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "../coro.hh"
+#include "../io.hh"
+#include "tcp.hh"
+
+/* kernel side data transfers. the bytes moved by these
+ * never get copied into userspace buffers. */
+
+namespace birdsong {
+
+/* sends len bytes of the file, starting at offset, out of the socket.
+ * waits on the reactor whenever the socket would block. returns
+ * the number of bytes sent, which is only short of len if the
+ * file ended first. */
+Coro<IOResult<std::size_t>>
+sendfile(unsigned file_fd, TCPSocket& socket, off_t offset, std::size_t len);
+
+struct Transferred
+{
+  std::uint64_t a_to_b;
+  std::uint64_t b_to_a;
+};
+
+/* copies bytes both ways between the two sockets through a kernel
+ * pipe per direction, until both have reached eof. eof on one
+ * socket is propagated by shutting down the write side of the other.
+ * an error in either direction shuts both sockets down entirely.
+ * this is proxy() with its defaults, see tools/proxy.hh */
+Coro<IOResult<Transferred>>
+copy_bidirectional(TCPSocket& a, TCPSocket& b);
+
+};
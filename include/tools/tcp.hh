@@ -3,14 +3,20 @@
 #include <compare>
 #include <coroutine>
 #include <cstddef>
+#include <cstdint>
 #include <expected>
+#include <netinet/in.h>
+#include <memory>
 #include <optional>
 #include <span>
+#include <vector>
 
+#include "../atomic.hh"
 #include "../common.hh"
 #include "../coro.hh"
 #include "../io.hh"
 #include "../net.hh"
+#include "sockopt.hh"
 
 /* im _not_ trying to build a cross-platform networking
  * library here, so some of the internal posix networking
@@ -20,40 +26,82 @@ namespace birdsong {
 
 class TCPSocket
 {
-  struct Read : AwaitableBase
+  struct Read : SpeculativeIO
   {
     Read(TCPSocket& socket, std::span<std::byte> buf)
-      : socket(socket)
+      : SpeculativeIO(socket.m_fd, { true, false })
       , buf(buf) {};
 
     bool await_ready();
-    void await_suspend(std::coroutine_handle<>);
     std::expected<unsigned, unsigned> await_resume();
 
-    TCPSocket& socket;
+    long attempt();
     std::span<std::byte> buf;
   };
 
-  struct Write : AwaitableBase
+  struct Write : SpeculativeIO
   {
     Write(TCPSocket& socket, std::span<const std::byte> buf)
-      : socket(socket)
+      : SpeculativeIO(socket.m_fd, { false, true })
       , buf(buf) {};
 
     bool await_ready();
-    void await_suspend(std::coroutine_handle<>);
     IOResult<unsigned> await_resume();
 
-    TCPSocket& socket;
+    long attempt();
+    std::span<std::byte const> buf;
+  };
+
+  struct ReadVectored : SpeculativeIO
+  {
+    ReadVectored(TCPSocket& socket, std::span<std::span<std::byte> const> bufs)
+      : SpeculativeIO(socket.m_fd, { true, false })
+      , bufs(bufs) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::span<std::byte> const> bufs;
+  };
+
+  struct WriteVectored : SpeculativeIO
+  {
+    WriteVectored(TCPSocket& socket,
+                  std::span<std::span<std::byte const> const> bufs)
+      : SpeculativeIO(socket.m_fd, { false, true })
+      , bufs(bufs) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::span<std::byte const> const> bufs;
+  };
+
+  struct ZerocopyWrite : SpeculativeIO
+  {
+    ZerocopyWrite(TCPSocket& socket, std::span<const std::byte> buf)
+      : SpeculativeIO(socket.m_fd, { false, true })
+      , buf(buf) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
     std::span<std::byte const> buf;
   };
 
   struct Connect : AwaitableBase
   {
-    Connect(unsigned int m_fd, unsigned int m_addr, unsigned short m_port)
+    Connect(unsigned int m_fd,
+            unsigned int m_addr,
+            unsigned short m_port,
+            SocketProfile const& m_profile)
       : m_fd(m_fd)
       , m_addr(m_addr)
-      , m_port(m_port) {};
+      , m_port(m_port)
+      , m_profile(m_profile) {};
 
     bool await_ready();
     void await_suspend(std::coroutine_handle<>);
@@ -62,6 +110,7 @@ class TCPSocket
     unsigned m_fd;
     unsigned m_addr;
     unsigned short m_port;
+    SocketProfile m_profile;
   };
 
 public:
@@ -74,45 +123,190 @@ public:
   TCPSocket(TCPSocket&&);
   TCPSocket& operator=(TCPSocket&&);
 
-  static Connect connect(Runtime&, unsigned short port, uint32_t address);
+  /* the profile is applied before the handshake, on a best effort basis */
+  static Connect connect(Runtime&,
+                         unsigned short port,
+                         uint32_t address,
+                         SocketProfile const& profile = {});
 
   Read read(std::span<std::byte> buffer);
   Write write(std::span<std::byte const> buffer);
+
+  /* reads into a pooled buffer, only borrowed once there is data */
+  BorrowedRead read_borrowed(BufferPool& pool = BufferPool::shared())
+  {
+    return BorrowedRead(m_fd, pool);
+  }
+
+  /* scatter/gather reads & writes. only the first MaxIOVecs
+   * non-empty buffers are used by a single call */
+  ReadVectored read_vectored(std::span<std::span<std::byte> const> buffers);
+  WriteVectored write_vectored(
+    std::span<std::span<std::byte const> const> buffers);
+  /* writes the whole buffer with MSG_ZEROCOPY, so the kernel sends
+   * straight out of the buffers pages rather than copying them.
+   * only completes once the kernel has released every page,
+   * so the buffer can be reused or freed as soon as this resumes.
+   * the completion round trip costs more than a copy for small
+   * writes, only use this for large payloads. */
+  Coro<IOResult<unsigned>> write_zerocopy(std::span<std::byte const> buffer);
+
+  template<typename Opt>
+  IOResult<Empty> set(typename Opt::Value value)
+  {
+    return set_option<Opt>(m_fd, value);
+  }
+
+  template<typename Opt>
+  IOResult<typename Opt::Value> get()
+  {
+    return get_option<Opt>(m_fd);
+  }
+
+  /* pushes out any partial frames held back by TCP_CORK,
+   * leaving the socket corked for the next batch of writes */
+  IOResult<Empty> uncork();
+
   IPAddr const& addr() const;
+  unsigned fd() const { return m_fd; }
 
 private:
+  /* drains zerocopy completion notifications off the error queue */
+  IOResult<Empty> reap_zerocopy();
+
   unsigned m_fd = -1u;
   IPAddr m_addr;
+
+  /* zerocopy sends issued & sends released by the kernel.
+   * these wrap in lockstep with the kernels 32 bit counter */
+  std::uint32_t m_zcSent = 0;
+  std::uint32_t m_zcDone = 0;
+  bool m_zcEnabled = false;
 };
 
 class TCPListener
 {
-  class AcceptAwaiter
+  class AcceptAwaiter : public SpeculativeIO
   {
   public:
     AcceptAwaiter(TCPListener& listener);
 
     bool await_ready();
-    void await_suspend(std::coroutine_handle<>);
 
     /* if a connection is aborted in the process of accepting,
      * then this function can return nullopt */
     std::optional<TCPSocket> await_resume();
 
   private:
+    long attempt();
+
     TCPListener& listener;
+    struct sockaddr_in m_addr;
+  };
+
+  class AcceptBatchAwaiter : public FDReady
+  {
+  public:
+    AcceptBatchAwaiter(TCPListener& listener, unsigned max);
+
+    bool await_ready();
+
+    /* every connection accepted during this wakeup, at least one.
+     * an error is only reported if nothing could be accepted */
+    IOResult<std::vector<TCPSocket>> await_resume();
+
+  private:
+    /* accepts until max is reached or the backlog is empty.
+     * returns false if nothing was pending */
+    bool drain();
+
+    TCPListener& listener;
+    unsigned m_max;
+    std::vector<TCPSocket> m_accepted;
+    std::optional<unsigned> m_error;
   };
 
 public:
-  TCPListener(unsigned short port, unsigned queue_size = 16);
+  /* with reuse_port set, several listeners may bind the same port,
+   * and the kernel spreads incoming connections across them */
+  TCPListener(unsigned short port,
+              unsigned queue_size = 16,
+              bool reuse_port = false);
   ~TCPListener();
 
+  TCPListener(const TCPListener&) = delete;
+  TCPListener& operator=(const TCPListener&) = delete;
+
   /* asynchronously blocks this thread and awaits
    * an incoming connection */
   AcceptAwaiter accept();
 
+  /* like accept, but drains up to max pending connections
+   * per wakeup, saving a reactor round trip per connection
+   * when connections arrive in bursts */
+  AcceptBatchAwaiter accept_batch(unsigned max = 64);
+
+  /* applies the listener side of the profile straight away, the rest
+   * is applied to every socket accepted from then on, on a best effort
+   * basis. set this before any task starts accepting */
+  IOResult<Empty> set_profile(SocketProfile const&);
+
+  /* stops listening, returning every connection that was already
+   * queued on this listener rather than letting the kernel reset them.
+   * tasks waiting to accept are woken, and get nothing back.
+   * the fd itself stays open until the listener is destroyed */
+  std::vector<TCPSocket> shutdown();
+
+  unsigned fd() const { return m_fd; }
+
 private:
   unsigned m_fd = -1u;
+  SocketProfile m_profile;
+};
+
+/* a group of SO_REUSEPORT listeners all bound to the same port.
+ * the kernel hashes each incoming connection onto one of the group,
+ * so every shard has its own accept queue & reactor registration and
+ * accepting doesn't serialize on a single listening socket.
+ * run one accept loop per shard. shards can be added & removed
+ * whilst serving, see remove_shard. */
+class ShardedListener : public Atom
+{
+public:
+  using Shard = std::shared_ptr<TCPListener>;
+
+  struct Data
+  {
+    std::vector<Shard> shards;
+  };
+
+  ShardedListener(unsigned short port,
+                  unsigned num_shards,
+                  unsigned queue_size = 16,
+                  SocketProfile const& profile = {});
+
+  ShardedListener(const ShardedListener&) = delete;
+  ShardedListener& operator=(const ShardedListener&) = delete;
+
+  /* opens another listener in the group */
+  Shard add_shard();
+
+  /* takes a shard out of the group. connections already queued
+   * on it are handed back so they can be served elsewhere. there is
+   * a small window where a connection can land on the shard between
+   * draining & closing it, those are reset by the kernel */
+  std::vector<TCPSocket> remove_shard(Shard const&);
+
+  /* snapshot of the current shards */
+  std::vector<Shard> shards();
+
+  Data& get_data(Atom::Key) { return m_data; }
+
+private:
+  unsigned short const m_port;
+  unsigned const m_queueSize;
+  SocketProfile const m_profile;
+  Data m_data;
 };
 
 };
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <expected>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "../common.hh"
+#include "../coro.hh"
+#include "../io.hh"
+#include "../runtime.hh"
+#include "../task.hh"
+#include "../timer.hh"
+
+namespace birdsong {
+
+template<typename T>
+struct TimeoutResult
+{
+  using type = IOResult<T>;
+};
+
+/* awaitables that already report errnos aren't wrapped a second time */
+template<typename T>
+struct TimeoutResult<IOResult<T>>
+{
+  using type = IOResult<T>;
+};
+
+/* wraps another awaitable, resuming with ETIMEDOUT if the wrapped
+ * awaitable has not woken the task by the deadline. the timer entry
+ * races the wrapped awaitables own waker (reactor registration,
+ * channel, etc.) for the task, and whichever loses is dropped.
+ * awaitables that reschedule themselves inside of await_suspend,
+ * such as Coro's, always win the race and can't be timed out. */
+template<typename A>
+class WithDeadline : public AwaitableBase
+{
+  using Inner = decltype(std::declval<A&>().await_resume());
+
+public:
+  using Result = typename TimeoutResult<Inner>::type;
+
+  WithDeadline(const WithDeadline&) = delete;
+  WithDeadline(WithDeadline&&) = delete;
+  WithDeadline& operator=(const WithDeadline&) = delete;
+  WithDeadline& operator=(WithDeadline&&) = delete;
+
+  WithDeadline(A&& inner, TimerWheel::Clock::time_point deadline)
+    : m_inner(std::forward<A>(inner))
+    , m_deadline(deadline) {};
+
+  ~WithDeadline()
+  {
+    if (m_runtime)
+      m_runtime->timers().cancel(m_entry);
+  }
+
+  /* the wrapped awaitables fast path is still taken,
+   * even if the deadline has already passed */
+  bool await_ready() { return m_inner.await_ready(); }
+
+  bool await_suspend(std::coroutine_handle<> handle)
+  {
+    if (m_deadline == TimerWheel::Clock::time_point::max())
+      return suspend_inner(handle);
+
+    m_runtime = basic_handle_from_void(handle).promise().runtime;
+    m_runtime->open_race();
+
+    bool const suspended = suspend_inner(handle);
+
+    if (suspended) {
+      Waker waker = m_runtime->create_waker();
+      m_timerId = waker.race_id();
+      m_runtime->timer_insert(m_entry, m_deadline, std::move(waker));
+    }
+
+    m_race = m_runtime->close_race(suspended);
+    return suspended;
+  }
+
+  Result await_resume()
+  {
+    if (m_runtime)
+      m_runtime->timers().cancel(m_entry);
+
+    /* no timer is armed if the inner awaitable completed without
+     * suspending, and then its result always stands */
+    if (m_race && m_timerId != -1u && m_race->won_by(m_timerId))
+      return std::unexpected(ETIMEDOUT);
+
+    return m_inner.await_resume();
+  }
+
+private:
+  bool suspend_inner(std::coroutine_handle<> handle)
+  {
+    using Ret = decltype(m_inner.await_suspend(handle));
+
+    if constexpr (std::is_same_v<Ret, bool>)
+      return m_inner.await_suspend(handle);
+    else {
+      m_inner.await_suspend(handle);
+      return true;
+    }
+  }
+
+  A m_inner;
+  TimerWheel::Clock::time_point m_deadline;
+  TimerWheel::Entry m_entry;
+
+  Runtime* m_runtime = nullptr;
+  std::shared_ptr<WakeRace> m_race;
+  unsigned m_timerId{ -1u };
+};
+
+/* lvalue awaitables are wrapped by reference, temporaries are moved in.
+ * a deadline of time_point::max() never fires, and costs nothing */
+template<typename A>
+WithDeadline<A>
+with_deadline(A&& awaitable, TimerWheel::Clock::time_point deadline)
+{
+  return WithDeadline<A>(std::forward<A>(awaitable), deadline);
+}
+
+template<typename A, typename Rep, typename Period>
+WithDeadline<A>
+with_timeout(A&& awaitable, std::chrono::duration<Rep, Period> timeout)
+{
+  return WithDeadline<A>(std::forward<A>(awaitable),
+                         TimerWheel::Clock::now() + timeout);
+}
+
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <span>
+#include <sys/socket.h>
+#include <vector>
+
+#include "../buffer.hh"
+#include "../common.hh"
+#include "../io.hh"
+#include "../net.hh"
+
+namespace birdsong {
+
+/* one received datagram. buf is provided by the caller, either
+ * owned outright or borrowed from a BufferPool, and is filled in
+ * along with the rest of the fields once the datagram arrives */
+struct RecvDatagram
+{
+  std::span<std::byte> buf;
+
+  /* bytes of buf that were filled */
+  unsigned len = 0;
+  IPAddr from{ 0, 0 };
+
+  /* the datagram was larger than buf, the rest was dropped */
+  bool truncated = false;
+
+  /* with gro enabled, buf may hold several coalesced datagrams
+   * of this size, the last of which may be shorter.
+   * 0 if the datagram wasn't coalesced */
+  unsigned short segment_size = 0;
+};
+
+struct SendDatagram
+{
+  std::span<std::byte const> buf;
+  IPAddr to;
+};
+
+/* points each of out at a fresh buffer of at least size bytes from the
+ * pool, resetting the rest of its fields. the buffers are appended to
+ * bufs, which must be kept alive for as long as out is in use.
+ * clearing & reusing bufs between batches keeps receiving malloc free */
+void
+borrow_buffers(std::span<RecvDatagram> out,
+               std::vector<BufferPool::Buffer>& bufs,
+               std::size_t size = 2048,
+               BufferPool& pool = BufferPool::shared());
+
+class UDPSocket
+{
+public:
+  /* most datagrams moved by a single recvmmsg/sendmmsg */
+  static constexpr unsigned MaxBatch = 64;
+
+private:
+  struct RecvBatch : SpeculativeIO
+  {
+    RecvBatch(UDPSocket& socket, std::span<RecvDatagram> out)
+      : SpeculativeIO(socket.m_fd, { true, false })
+      , out(out) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<RecvDatagram> out;
+  };
+
+  struct SendBatch : SpeculativeIO
+  {
+    SendBatch(UDPSocket& socket, std::span<SendDatagram const> in)
+      : SpeculativeIO(socket.m_fd, { false, true })
+      , in(in) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<SendDatagram const> in;
+  };
+
+public:
+  /* binds a new socket to the port on the given address,
+   * port 0 picks an ephemeral port */
+  UDPSocket(unsigned short port, std::uint32_t address = INADDR_ANY);
+  ~UDPSocket();
+
+  UDPSocket(const UDPSocket&) = delete;
+  UDPSocket& operator=(const UDPSocket&) = delete;
+
+  UDPSocket(UDPSocket&&);
+
+  /* receives up to MaxBatch datagrams in a single syscall,
+   * resuming with the number of entries of out that were filled */
+  RecvBatch recv_batch(std::span<RecvDatagram> out);
+
+  /* sends up to MaxBatch datagrams in a single syscall,
+   * resuming with the number that were sent. like a short write,
+   * fewer than were given may be sent */
+  SendBatch send_batch(std::span<SendDatagram const> in);
+
+  /* generic segmentation offload. every datagram sent is split by the
+   * kernel (or nic) into segments of segment_size, so one large buffer
+   * goes out as many datagrams. 0 turns it back off */
+  IOResult<Empty> set_gso(unsigned short segment_size);
+
+  /* generic receive offload, datagrams from the same flow may be
+   * coalesced into one buffer, see RecvDatagram::segment_size */
+  IOResult<Empty> set_gro(bool enable);
+
+  /* the address the socket is bound to */
+  IPAddr local_addr() const;
+  unsigned fd() const { return m_fd; }
+
+private:
+  unsigned m_fd = -1u;
+};
+
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "../common.hh"
+#include "../io.hh"
+
+namespace birdsong {
+
+/* unix domain sockets, for talking to other processes on the same
+ * machine without going through the tcp stack. stream sockets behave
+ * like a TCPSocket, seqpacket sockets are connection oriented but keep
+ * message boundaries, each write is read back out by exactly one read. */
+class UnixSocket
+{
+public:
+  enum class Kind
+  {
+    Stream,
+    SeqPacket,
+  };
+
+  /* most file descriptors passed in a single message */
+  static constexpr unsigned MaxFDs = 16;
+
+  struct FDsReceived
+  {
+    unsigned bytes;
+    unsigned fds;
+  };
+
+private:
+  struct Read : SpeculativeIO
+  {
+    Read(UnixSocket& socket, std::span<std::byte> buf)
+      : SpeculativeIO(socket.m_fd, { true, false })
+      , buf(buf) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::byte> buf;
+  };
+
+  struct Write : SpeculativeIO
+  {
+    Write(UnixSocket& socket, std::span<std::byte const> buf)
+      : SpeculativeIO(socket.m_fd, { false, true })
+      , buf(buf) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::byte const> buf;
+  };
+
+  struct SendFDs : SpeculativeIO
+  {
+    SendFDs(UnixSocket& socket,
+            std::span<std::byte const> buf,
+            std::span<int const> fds)
+      : SpeculativeIO(socket.m_fd, { false, true })
+      , buf(buf)
+      , fds(fds) {};
+
+    bool await_ready();
+    IOResult<unsigned> await_resume();
+
+    long attempt();
+    std::span<std::byte const> buf;
+    std::span<int const> fds;
+  };
+
+  struct RecvFDs : SpeculativeIO
+  {
+    RecvFDs(UnixSocket& socket, std::span<std::byte> buf, std::span<int> fds)
+      : SpeculativeIO(socket.m_fd, { true, false })
+      , buf(buf)
+      , fds(fds) {};
+
+    bool await_ready();
+    IOResult<FDsReceived> await_resume();
+
+    long attempt();
+    std::span<std::byte> buf;
+    std::span<int> fds;
+    unsigned m_received = 0;
+  };
+
+public:
+  explicit UnixSocket(unsigned fd);
+  ~UnixSocket();
+
+  UnixSocket(const UnixSocket&) = delete;
+  UnixSocket& operator=(const UnixSocket&) = delete;
+
+  UnixSocket(UnixSocket&&);
+  UnixSocket& operator=(UnixSocket&&);
+
+  /* local connects never wait on a handshake, so this doesn't suspend.
+   * EAGAIN means the listeners backlog is full */
+  static IOResult<UnixSocket> connect(std::string_view path,
+                                      Kind = Kind::Stream);
+
+  /* a connected pair of sockets, such as for handing to a child process */
+  static IOResult<std::pair<UnixSocket, UnixSocket>> pair(Kind = Kind::Stream);
+
+  Read read(std::span<std::byte> buffer);
+  Write write(std::span<std::byte const> buffer);
+
+  /* reads into a pooled buffer, only borrowed once there is data */
+  BorrowedRead read_borrowed(BufferPool& pool = BufferPool::shared())
+  {
+    return BorrowedRead(m_fd, pool);
+  }
+
+  /* sends buf along with duplicates of the given descriptors.
+   * at least one byte of buf must be sent for the descriptors to go
+   * with it, and at most MaxFDs descriptors can be sent at a time */
+  SendFDs send_fds(std::span<std::byte const> buf, std::span<int const> fds);
+
+  /* receives into buf, taking ownership of any descriptors sent along
+   * with it. received descriptors are close-on-exec. any received past
+   * the size of fds are closed by recv_fds rather than handed out, and
+   * any past MaxFDs are discarded by the kernel without arriving */
+  RecvFDs recv_fds(std::span<std::byte> buf, std::span<int> fds);
+
+  unsigned fd() const { return m_fd; }
+
+private:
+  unsigned m_fd = -1u;
+};
+
+class UnixListener
+{
+  class AcceptAwaiter : public SpeculativeIO
+  {
+  public:
+    AcceptAwaiter(UnixListener& listener);
+
+    bool await_ready();
+    std::optional<UnixSocket> await_resume();
+
+  private:
+    long attempt();
+
+    UnixListener& listener;
+  };
+
+public:
+  /* binds to path, removing whatever stale socket is left there.
+   * if anything other than a socket is at the path, binding fails
+   * with EADDRINUSE. the path is unlinked again once the listener
+   * is destroyed */
+  UnixListener(std::string path,
+               UnixSocket::Kind = UnixSocket::Kind::Stream,
+               unsigned queue_size = 16);
+  ~UnixListener();
+
+  UnixListener(const UnixListener&) = delete;
+  UnixListener& operator=(const UnixListener&) = delete;
+
+  AcceptAwaiter accept();
+
+private:
+  std::string m_path;
+  unsigned m_fd = -1u;
+};
+
+};
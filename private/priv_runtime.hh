@@ -19,6 +19,9 @@ struct Runtime::Data
   struct ThreadData
   {
     std::unique_ptr<Task> m_currentTask;
+
+    /* set between open_race & close_race */
+    std::shared_ptr<WakeRace> m_race;
   };
 
   std::map<ThreadQueue::ThreadID, ThreadData> m_threadData;
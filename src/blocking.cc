@@ -0,0 +1,16 @@
+#include <algorithm>
+#include <thread>
+
+#include "blocking.hh"
+
+using namespace birdsong;
+
+ThreadQueue&
+birdsong::blocking_pool()
+{
+  /* blocked threads don't use any cpu, so there are more of
+   * these than cores, enough to keep a disk queue busy */
+  static ThreadQueue pool(std::max(16u, std::thread::hardware_concurrency()),
+                          BlockingThreadID);
+  return pool;
+}
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/mman.h>
+#include <vector>
+
+#include "buffer.hh"
+
+using namespace birdsong;
+
+using Core = BufferPool::Core;
+using Cache = BufferPool::Cache;
+
+namespace {
+
+constexpr std::size_t SlabSize = 2 << 20;
+
+struct ThreadCaches
+{
+  std::vector<std::shared_ptr<Cache>> caches;
+  ~ThreadCaches();
+};
+
+thread_local ThreadCaches t_caches;
+
+/* set once t_caches is destroyed, buffers dropped by other
+ * thread locals after that go straight back to their pool */
+thread_local bool t_cachesGone = false;
+
+/* hands every buffer in the cache back to the core for good */
+void
+empty_cache(Cache& cache, Core& core)
+{
+  std::array<std::vector<std::byte*>, BufferPool::NumClasses> free;
+
+  {
+    auto trans = cache.acquire();
+    if (trans->dead)
+      return;
+    trans->dead = true;
+    free.swap(trans->free);
+  }
+
+  for (unsigned cls = 0; cls < BufferPool::NumClasses; cls++)
+    core.give(cls, free[cls], 0);
+}
+
+ThreadCaches::~ThreadCaches()
+{
+  /* a pool that is already gone emptied its caches on the way out */
+  for (auto& cache : caches)
+    if (auto core = cache->core.lock())
+      empty_cache(*cache, *core);
+  t_cachesGone = true;
+}
+
+/* the calling threads cache for the pool, created on first use.
+ * nullptr once the pool has been destroyed */
+Cache*
+cache_for(std::shared_ptr<Core> const& core)
+{
+  auto& caches = t_caches.caches;
+
+  /* a cache of a dead core at the same address has expired */
+  for (auto& cache : caches)
+    if (cache->id == core.get() && not cache->core.expired())
+      return cache.get();
+
+  auto cache = std::make_shared<Cache>(core);
+
+  {
+    auto trans = core->acquire();
+    if (core->closed.load(std::memory_order_acquire))
+      return nullptr;
+    std::erase_if(trans->caches, [](auto& weak) { return weak.expired(); });
+    trans->caches.push_back(cache);
+  }
+
+  std::erase_if(caches, [](auto& cache) { return cache->core.expired(); });
+  return caches.emplace_back(std::move(cache)).get();
+}
+
+/* a 2MB aligned slab. huge pages are used if any are reserved, else
+ * the slab is aligned by hand so that it can be backed transparently */
+std::byte*
+map_slab()
+{
+  void* mem = mmap(nullptr,
+                   SlabSize,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1,
+                   0);
+
+  if (mem != MAP_FAILED)
+    return static_cast<std::byte*>(mem);
+
+  mem = mmap(nullptr,
+             SlabSize * 2,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS,
+             -1,
+             0);
+  if (mem == MAP_FAILED)
+    throw std::bad_alloc();
+
+  auto* const base = static_cast<std::byte*>(mem);
+  auto const addr = reinterpret_cast<std::uintptr_t>(base);
+  auto const head = (SlabSize - addr % SlabSize) % SlabSize;
+
+  /* trim the mapping down to the aligned window within it */
+  if (head != 0)
+    munmap(base, head);
+  if (head != SlabSize)
+    munmap(base + head + SlabSize, SlabSize - head);
+
+  madvise(base + head, SlabSize, MADV_HUGEPAGE);
+  return base + head;
+}
+
+};
+
+Core::~Core()
+{
+  auto trans = acquire();
+
+  if (not config.hugepages)
+    for (auto& list : trans->free)
+      for (auto* buf : list)
+        delete[] buf;
+
+  for (auto slab : trans->slabs)
+    munmap(slab.data(), slab.size());
+}
+
+unsigned
+Core::cache_limit(unsigned cls) const
+{
+  return config.thread_cache_bytes / BufferPool::class_size(cls);
+}
+
+std::byte*
+Core::allocate(unsigned cls)
+{
+  auto const size = BufferPool::class_size(cls);
+
+  if (not config.hugepages)
+    return new std::byte[size];
+
+  auto* const slab = map_slab();
+
+  /* the first buffer is handed straight out, the rest are freed */
+  auto trans = acquire();
+  trans->slabs.emplace_back(slab, SlabSize);
+  for (std::size_t off = size; off + size <= SlabSize; off += size)
+    trans->free[cls].push_back(slab + off);
+  trans->free_bytes += SlabSize - size;
+
+  return slab;
+}
+
+std::byte*
+Core::take(unsigned cls)
+{
+  auto trans = acquire();
+  auto& list = trans->free[cls];
+
+  if (list.empty())
+    return nullptr;
+
+  auto* const buf = list.back();
+  list.pop_back();
+  trans->free_bytes -= BufferPool::class_size(cls);
+  return buf;
+}
+
+void
+Core::take(unsigned cls, std::vector<std::byte*>& out, unsigned n)
+{
+  auto trans = acquire();
+  auto& list = trans->free[cls];
+  auto const count = std::min<std::size_t>(n, list.size());
+
+  out.insert(out.end(), list.end() - count, list.end());
+  list.resize(list.size() - count);
+  trans->free_bytes -= count * BufferPool::class_size(cls);
+}
+
+void
+Core::give(unsigned cls, std::byte* buf)
+{
+  auto const size = BufferPool::class_size(cls);
+  bool const closed = this->closed.load(std::memory_order_acquire);
+
+  {
+    auto trans = acquire();
+
+    /* slab buffers can't be freed on their own, so are always kept */
+    if (config.hugepages ||
+        (not closed && trans->free_bytes + size <= config.max_free_bytes)) {
+      trans->free[cls].push_back(buf);
+      trans->free_bytes += size;
+      return;
+    }
+  }
+
+  delete[] buf;
+}
+
+void
+Core::give(unsigned cls, std::vector<std::byte*>& in, unsigned keep)
+{
+  if (in.size() <= keep)
+    return;
+
+  auto const size = BufferPool::class_size(cls);
+  bool const closed = this->closed.load(std::memory_order_acquire);
+
+  {
+    auto trans = acquire();
+    auto& list = trans->free[cls];
+
+    std::size_t count = in.size() - keep;
+    if (not config.hugepages) {
+      auto const room =
+        config.max_free_bytes -
+        std::min(config.max_free_bytes, trans->free_bytes);
+      count = closed ? 0 : std::min(count, room / size);
+    }
+
+    list.insert(list.end(), in.end() - count, in.end());
+    in.resize(in.size() - count);
+    trans->free_bytes += count * size;
+  }
+
+  for (auto it = in.begin() + keep; it != in.end(); it++)
+    delete[] *it;
+  in.resize(keep);
+}
+
+BufferPool::BufferPool()
+  : BufferPool(Config{}) {};
+
+BufferPool::BufferPool(Config config)
+  : m_core(std::make_shared<Core>(config)) {};
+
+BufferPool::~BufferPool()
+{
+  m_core->closed.store(true, std::memory_order_release);
+
+  /* every thread cache is emptied now, rather than whenever its
+   * thread next happens to touch a pool */
+  std::vector<std::weak_ptr<Cache>> caches;
+  caches.swap(m_core->acquire()->caches);
+
+  for (auto& weak : caches)
+    if (auto cache = weak.lock())
+      empty_cache(*cache, *m_core);
+}
+
+BufferPool&
+BufferPool::shared()
+{
+  static BufferPool pool;
+  return pool;
+}
+
+unsigned
+BufferPool::class_for(std::size_t size)
+{
+  if (size > MaxClass)
+    return NumClasses;
+  if (size <= MinClass)
+    return 0;
+  return std::bit_width((size - 1) / MinClass);
+}
+
+std::size_t
+BufferPool::buffer_size() const
+{
+  auto const size = m_core->config.buffer_size;
+  auto const cls = class_for(size);
+  return cls == NumClasses ? size : class_size(cls);
+}
+
+auto
+BufferPool::get() -> Buffer
+{
+  return get(m_core->config.buffer_size);
+}
+
+auto
+BufferPool::get(std::size_t min_size) -> Buffer
+{
+  auto const cls = class_for(min_size);
+
+  if (cls == NumClasses)
+    return Buffer(m_core, new std::byte[min_size], min_size, cls);
+
+  auto const limit = m_core->cache_limit(cls);
+  auto* const cache =
+    limit != 0 && not t_cachesGone ? cache_for(m_core) : nullptr;
+
+  if (cache) {
+    auto trans = cache->acquire();
+    auto& list = trans->free[cls];
+
+    if (list.empty())
+      m_core->take(cls, list, std::max(1u, limit / 2));
+
+    if (not list.empty()) {
+      auto* const buf = list.back();
+      list.pop_back();
+      return Buffer(m_core, buf, class_size(cls), cls);
+    }
+  } else if (auto* const buf = m_core->take(cls))
+    return Buffer(m_core, buf, class_size(cls), cls);
+
+  return Buffer(m_core, m_core->allocate(cls), class_size(cls), cls);
+}
+
+BufferPool::Buffer::~Buffer()
+{
+  if (not m_data)
+    return;
+
+  if (m_class == NumClasses) {
+    delete[] m_data;
+    return;
+  }
+
+  auto const limit = m_core->cache_limit(m_class);
+  auto* const cache =
+    limit != 0 && not t_cachesGone &&
+        not m_core->closed.load(std::memory_order_acquire)
+      ? cache_for(m_core)
+      : nullptr;
+
+  /* once the cache overflows, half of it is moved to the shared list
+   * so the next few returns don't each have to take the shared lock */
+  if (cache) {
+    auto trans = cache->acquire();
+    if (not trans->dead) {
+      auto& list = trans->free[m_class];
+      list.push_back(m_data);
+      if (list.size() > limit)
+        m_core->give(m_class, list, limit / 2);
+      return;
+    }
+  }
+
+  m_core->give(m_class, m_data);
+}
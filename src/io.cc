@@ -0,0 +1,114 @@
+#include <cerrno>
+#include <coroutine>
+#include <sys/socket.h>
+
+#include "coro.hh"
+#include "io.hh"
+#include "reactor.hh"
+#include "runtime.hh"
+
+using namespace birdsong;
+
+void
+FDReady::await_suspend(std::coroutine_handle<> handle)
+{
+  auto rt = basic_handle_from_void(handle).promise().runtime;
+  rt->reactor_insert({ rt->create_waker(), m_fd, m_mask });
+}
+
+bool
+SpeculativeIO::settle(long ret)
+{
+  if (ret >= 0)
+    m_result.emplace(ret);
+  else if (errno == EAGAIN || errno == EWOULDBLOCK)
+    return false;
+  else
+    m_result.emplace(std::unexpected(errno));
+
+  return true;
+}
+
+bool
+BorrowedRead::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<Borrowed>
+BorrowedRead::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  auto const res = take();
+  if (not res)
+    return std::unexpected(res.error());
+
+  return Borrowed{ std::move(*m_buf), *res };
+}
+
+long
+BorrowedRead::attempt()
+{
+  if (not m_buf)
+    m_buf.emplace(m_pool.get());
+
+  long const ret = ::recv(m_fd, m_buf->data(), m_buf->size(), MSG_DONTWAIT);
+
+  /* nothing to read, so dont sit on the buffer whilst waiting */
+  if (ret < 0) {
+    int const err = errno;
+    m_buf.reset();
+    errno = err;
+  }
+
+  return ret;
+}
+
+IOResult<unsigned>
+SpeculativeIO::take()
+{
+  if (not m_result)
+    return std::unexpected(EAGAIN);
+
+  auto out = std::move(*m_result);
+  m_result.reset();
+  return out;
+}
+
+template<typename Span>
+static unsigned
+fill_iovecs(std::span<Span const> bufs, std::span<iovec, MaxIOVecs> out)
+{
+  unsigned count = 0;
+
+  for (auto const& buf : bufs) {
+    if (count == MaxIOVecs)
+      break;
+
+    /* empty buffers would just waste iovec slots */
+    if (buf.empty())
+      continue;
+
+    out[count].iov_base = (void*)buf.data();
+    out[count].iov_len = buf.size_bytes();
+    count++;
+  }
+
+  return count;
+}
+
+unsigned
+birdsong::to_iovecs(std::span<std::span<std::byte> const> bufs,
+                    std::span<iovec, MaxIOVecs> out)
+{
+  return fill_iovecs(bufs, out);
+}
+
+unsigned
+birdsong::to_iovecs(std::span<std::span<std::byte const> const> bufs,
+                    std::span<iovec, MaxIOVecs> out)
+{
+  return fill_iovecs(bufs, out);
+}
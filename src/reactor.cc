@@ -1,7 +1,10 @@
 #include <cstring>
+#include <format>
 #include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/poll.h>
 #include <sys/resource.h>
+#include <unistd.h>
 #include <vector>
 
 #include "reactor.hh"
@@ -16,6 +19,28 @@ struct PollReactor::Data
 
   unsigned laps = 0;
 
+  /* eventfd used to break out of a blocking poll */
+  int wakefd;
+
+  /* snapshot of pollfds that poll() blocks on without holding the lock.
+   * only ever touched by the polling thread */
+  std::vector<pollfd> polling;
+
+  /* true whilst poll() is blocked with a nonzero timeout */
+  bool sleeping = false;
+
+  /* true if wakefd has been written to & not yet drained */
+  bool interrupted = false;
+
+  void wake_poller()
+  {
+    if (interrupted)
+      return;
+
+    interrupted = true;
+    eventfd_write(wakefd, 1);
+  }
+
   /* used pollfd slot count
    * if < 1/2 of pollfds capacity & > 64, resize the
    * pollfd vector */
@@ -69,7 +94,12 @@ struct PollReactor::Data
       std::terminate();
 
     this->max_pollfds = limit.rlim_cur;
+
+    if ((wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+      std::terminate();
   };
+
+  ~Data() { close(wakefd); }
 };
 
 PollReactor::PollReactor()
@@ -81,19 +111,70 @@ PollReactor::insert(FDWait wait)
 {
   auto trans = acquire();
   trans->insert_at(trans->allocate_pfd(), std::move(wait));
+
+  /* a blocked poll wouldnt see the new fd until it times out */
+  if (trans->sleeping)
+    trans->wake_poller();
 }
 
 void
-PollReactor::poll()
+PollReactor::interrupt()
 {
-  auto trans = acquire();
-  auto num_updated = 0;
+  acquire()->wake_poller();
+}
+
+void
+PollReactor::poll(unsigned timeout_ms)
+{
+  std::vector<pollfd>& polling = m_data->polling;
 
-  if ((num_updated = ::poll(trans->pollfds.data(), trans->pollfds.size(), 0)) ==
-      -1)
+  /* poll over a snapshot so the lock isnt held whilst blocking.
+   * slots are only ever freed from within poll itself, so every
+   * snapshotted index still refers to the same wait afterwards */
+  {
+    auto trans = acquire();
+    polling.assign(trans->pollfds.begin(), trans->pollfds.end());
+    polling.push_back(pollfd{ trans->wakefd, POLLIN, 0 });
+    trans->sleeping = timeout_ms != 0;
+  }
+
+  auto num_updated = ::poll(polling.data(), polling.size(), timeout_ms);
+
+  if (num_updated == -1 && errno != EINTR)
     throw std::runtime_error(std::format(
       "fatal poll error in reactor! {} {}", errno, strerror(errno)));
 
+  auto trans = acquire();
+  trans->sleeping = false;
+
+  /* wakers are collected and handed to the scheduler in a single
+   * batch once the reactor lock has been released */
+  std::vector<Waker> ready;
+
+  if (polling.back().revents & POLLIN) {
+    eventfd_t val;
+    eventfd_read(trans->wakefd, &val);
+    trans->interrupted = false;
+    num_updated--;
+  }
+
+  /* only care to check the pollfds a second time
+   * if there has been any updates */
+  if (num_updated > 0) {
+    ready.reserve(num_updated);
+
+    for (unsigned i = 0; i < polling.size() - 1; i++) {
+      auto& pfd = polling[i];
+
+      if (pfd.fd == -1 || pfd.revents == 0)
+        continue;
+
+      FDWait& meta = trans->wakers.at(i).value();
+      ready.emplace_back(std::move(meta.waker));
+      trans->remove_at(i);
+    }
+  }
+
   /* every 50 "laps" of the reactor (up to 2 seconds)
    * iterate over all tasks in the reactor and check if
    * they're killed. if they are, drop them
@@ -108,8 +189,8 @@ PollReactor::poll()
         continue;
 
       auto& wait = trans->wakers[i];
-      if (wait->waker.acquire()->get()->acquire()->state.load()->killswitch) {
-        trans->wakers[i]->waker.wake();
+      if (wait->waker.defunct()) {
+        ready.emplace_back(std::move(wait->waker));
         trans->remove_at(i);
       }
     }
@@ -140,22 +221,6 @@ PollReactor::poll()
     }
   }
 
-  /* only care to check the pollfds a second time
-   * if there has been any updates */
-  if (num_updated == 0)
-    return;
-
-  for (unsigned i = 0; i < trans->pollfds.size(); i++) {
-    auto& pfd = trans->pollfds[i];
-
-    if (pfd.fd == -1)
-      continue;
-
-    FDWait& meta = trans->wakers.at(i).value();
-
-    if (pfd.revents != 0) {
-      meta.waker.wake();
-      trans->remove_at(i);
-    }
-  }
+  trans.drop();
+  Waker::wake_all(ready);
 }
@@ -2,8 +2,9 @@
 #include <chrono>
 #include <exception>
 #include <memory>
-#include <thread>
+#include <vector>
 
+#include "clock.hh"
 #include "priv_runtime.hh"
 #include "reactor.hh"
 #include "runtime.hh"
@@ -15,6 +16,7 @@ using namespace birdsong;
 Runtime::Runtime(std::unique_ptr<Reactor> reactor, unsigned num_threads)
   : m_data(new Data)
   , m_reactor(std::move(reactor))
+  , m_nativeReactor(dynamic_cast<NativeReactor*>(m_reactor.get()))
   , m_threadQueue(num_threads)
 {
   for (unsigned i = 0; i < num_threads; i++) {
@@ -36,10 +38,19 @@ Runtime::run(std::function<Coro<>()> coro)
 
   spawn_internal<Empty>(coro()).wake();
 
+  Config const config;
+  std::vector<Waker> expired;
+
+  /* the reactor blocks until either an fd is ready
+   * or the next timer on the wheel is due */
   while (acquire()->m_aliveTasks != 0) {
-    get_reactor().poll();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    m_timers.advance(CoarseClock::refresh(), expired);
+    Waker::wake_all(expired);
+
+    reactor_poll(m_timers.next_timeout(config.poll_ms_wait));
   }
+
+  CoarseClock::invalidate();
 }
 
 /* unsets the current task & creates a waker set to it */
@@ -51,7 +62,16 @@ Runtime::create_waker()
                  "call this method!",
       std::terminate();
 
-  auto& task = acquire()->get_this_thread_data().m_currentTask;
+  auto trans = acquire();
+  auto& data = trans->get_this_thread_data();
+  auto& task = data.m_currentTask;
+
+  if (data.m_race) {
+    MutexLock lock(data.m_race->mutex);
+    if (task)
+      data.m_race->task = std::move(task);
+    return Waker(*this, data.m_race, data.m_race->next_id++);
+  }
 
   if (!task)
     std::cerr << "no current task, panicking!\n", std::terminate();
@@ -59,6 +79,33 @@ Runtime::create_waker()
   return Waker(*this, std::move(task));
 }
 
+void
+Runtime::open_race()
+{
+  auto& data = acquire()->get_this_thread_data();
+
+  if (data.m_race)
+    std::cerr << "attempting to open nested wake races\n", std::terminate();
+
+  data.m_race = std::make_shared<WakeRace>();
+}
+
+std::shared_ptr<WakeRace>
+Runtime::close_race(bool suspended)
+{
+  auto trans = acquire();
+  auto& data = trans->get_this_thread_data();
+  auto race = std::move(data.m_race);
+
+  if (not suspended) {
+    MutexLock lock(race->mutex);
+    if (race->task)
+      data.m_currentTask = std::move(race->task);
+  }
+
+  return race;
+}
+
 Task&
 Runtime::current_task()
 {
@@ -1,6 +1,7 @@
 #include <memory>
 #include <utility>
 
+#include "clock.hh"
 #include "priv_runtime.hh"
 #include "runtime.hh"
 #include "task.hh"
@@ -11,43 +12,107 @@ Waker::Waker(Runtime& runtime, std::unique_ptr<Task> task)
   : runtime(runtime)
   , task(std::move(task)) {};
 
+Waker::Waker(Runtime& runtime, std::shared_ptr<WakeRace> race, unsigned id)
+  : runtime(runtime)
+  , m_race(std::move(race))
+  , m_raceId(id) {};
+
 Waker::Waker(Waker&& rhs)
   : runtime(rhs.runtime)
-  , task(std::move(*rhs.acquire())) {
+  , task(std::move(*rhs.acquire()))
+  , m_race(std::move(rhs.m_race))
+  , m_raceId(rhs.m_raceId) {
 
   };
 
-void
-Waker::wake()
+bool
+Waker::defunct()
+{
+  auto transaction = acquire();
+
+  if (m_race) {
+    MutexLock lock(m_race->mutex);
+    return not m_race->task or
+           m_race->task->acquire()->state.load()->killswitch;
+  }
+
+  return not task or task->acquire()->state.load()->killswitch;
+}
+
+std::optional<ThreadQueue::Job>
+Waker::take_job()
 {
   auto transaction = acquire();
 
+  /* racing wakers only get the task if theyre first */
+  if (m_race) {
+    MutexLock lock(m_race->mutex);
+    if (m_race->task) {
+      m_race->winner = m_raceId;
+      task = std::move(m_race->task);
+    }
+  }
+
   /* if the task no longer exists...
    * just quit. */
   if (not task)
-    return;
+    return std::nullopt;
+
+  return [&runtime = this->runtime, task = std::move(this->task)]() mutable {
+    auto state = task->acquire()->state.load();
+    state->mutex.lock();
+    auto valid = not state->killswitch;
+
+    auto handle = (runtime.acquire()
+                     ->m_threadData.at(ThreadQueue::GetThisThreadID())
+                     .m_currentTask = std::move(task))
+                    ->acquire()
+                    ->handle;
 
-  runtime.m_threadQueue.push_task(
-    [&runtime = this->runtime, task = std::move(this->task)]() mutable {
-      auto state = task->acquire()->state.load();
-      state->mutex.lock();
-      auto valid = not state->killswitch;
+    /* one clock read per scheduled task,
+     * every await within it uses the cached time */
+    CoarseClock::refresh();
+
+    if (valid && handle)
+      handle.resume();
+
+    auto fin = std::move(runtime.acquire()
+                           ->m_threadData.at(ThreadQueue::GetThisThreadID())
+                           .m_currentTask);
+
+    state->mutex.unlock();
+  };
+}
+
+void
+Waker::wake()
+{
+  if (auto job = take_job())
+    runtime.m_threadQueue.push_task(std::move(*job));
+}
+
+void
+Waker::wake_all(std::vector<Waker>& wakers)
+{
+  std::vector<ThreadQueue::Job> jobs;
+  jobs.reserve(wakers.size());
 
-      auto handle = (runtime.acquire()
-                       ->m_threadData.at(ThreadQueue::GetThisThreadID())
-                       .m_currentTask = std::move(task))
-                      ->acquire()
-                      ->handle;
+  /* wakers are grouped by runtime so that each
+   * runtimes queue is only touched once per run of wakers */
+  Runtime* runtime = nullptr;
+  for (auto& waker : wakers) {
+    if (runtime && runtime != &waker.runtime)
+      runtime->m_threadQueue.push_tasks(std::move(jobs));
 
-      if (valid && handle)
-        handle.resume();
+    runtime = &waker.runtime;
+    if (auto job = waker.take_job())
+      jobs.emplace_back(std::move(*job));
+  }
 
-      auto fin = std::move(runtime.acquire()
-                             ->m_threadData.at(ThreadQueue::GetThisThreadID())
-                             .m_currentTask);
+  if (runtime)
+    runtime->m_threadQueue.push_tasks(std::move(jobs));
 
-      state->mutex.unlock();
-    });
+  wakers.clear();
 }
 
 static std::atomic<int> m{ 0 };
@@ -25,9 +25,11 @@ public:
     for (;;) {
       std::unique_lock lock(m_jq.m_taskQueueMutex);
 
+      m_jq.m_numIdle++;
       m_jq.m_taskQueueNotify.wait(lock, [&] {
         return not m_jq.m_taskQueue.empty() or m_jq.m_taskQueueQuit;
       });
+      m_jq.m_numIdle--;
 
       /* quit exception */
       if (m_jq.m_taskQueueQuit)
@@ -49,12 +51,12 @@ private:
   ThreadQueue& m_jq;
 };
 
-ThreadQueue::ThreadQueue(unsigned num_workers)
+ThreadQueue::ThreadQueue(unsigned num_workers, ThreadID first_id)
   : m_numWorking(0)
 {
   for (unsigned i = 0; i < num_workers; i++) {
     Worker* worker = new Worker(*this);
-    m_threads.push_back({ std::thread(*worker, i), worker });
+    m_threads.push_back({ std::thread(*worker, first_id + i), worker });
   }
 }
 
@@ -96,10 +98,42 @@ ThreadQueue::operator+=(Job&& task)
 void
 ThreadQueue::push_task(Job&& task)
 {
+  unsigned idle;
+
   {
     std::lock_guard lock(m_taskQueueMutex);
     m_taskQueue.emplace(new Job(std::move(task)));
+    idle = m_numIdle;
+  }
+
+  /* busy workers always recheck the queue before
+   * going back to sleep, so they dont need a notify */
+  if (idle != 0)
+    m_taskQueueNotify.notify_one();
+}
+
+void
+ThreadQueue::push_tasks(std::vector<Job>&& tasks)
+{
+  if (tasks.empty())
+    return;
+
+  unsigned idle;
+
+  {
+    std::lock_guard lock(m_taskQueueMutex);
+    for (auto& task : tasks)
+      m_taskQueue.emplace(new Job(std::move(task)));
+    idle = m_numIdle;
   }
 
-  m_taskQueueNotify.notify_one();
+  if (idle == 0)
+    ;
+  else if (tasks.size() >= idle)
+    m_taskQueueNotify.notify_all();
+  else
+    for (unsigned i = 0; i < tasks.size(); i++)
+      m_taskQueueNotify.notify_one();
+
+  tasks.clear();
 }
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+
+#include "task.hh"
+#include "timer.hh"
+
+using namespace birdsong;
+
+struct TimerWheel::Data
+{
+  constexpr static unsigned SlotBits = 6;
+  constexpr static unsigned NumSlots = 1 << SlotBits;
+  constexpr static unsigned NumLevels = 4;
+
+  /* entries whose deadline had already passed when inserted,
+   * they are fired the next time the wheel is advanced */
+  constexpr static unsigned DueSlot = NumSlots * NumLevels;
+
+  std::array<Entry*, DueSlot + 1> slots{};
+  std::array<unsigned, NumLevels + 1> counts{};
+  Clock::time_point start = Clock::now();
+
+  /* tick the wheel was last advanced to */
+  std::uint64_t now = 0;
+
+  /* tick the wheel is expected to be advanced at next */
+  std::uint64_t armed = 0;
+
+  unsigned count() const
+  {
+    unsigned out = 0;
+    for (auto const c : counts)
+      out += c;
+    return out;
+  }
+
+  /* deadlines are rounded up so that timers never fire early */
+  std::uint64_t deadline_tick(Clock::time_point tp) const
+  {
+    if (tp <= start)
+      return 0;
+    return std::chrono::ceil<std::chrono::milliseconds>(tp - start).count();
+  }
+
+  std::uint64_t now_tick(Clock::time_point tp) const
+  {
+    if (tp <= start)
+      return 0;
+    return std::chrono::floor<std::chrono::milliseconds>(tp - start).count();
+  }
+
+  /* the level of an entry is picked by how far off its deadline is,
+   * and its slot within the level by the deadlines own bits. an entry
+   * is never more than a full rotation of its level ahead of the
+   * current tick, so its slot is cascaded before the deadline. */
+  unsigned slot_for(std::uint64_t deadline) const
+  {
+    if (deadline <= now)
+      return DueSlot;
+
+    unsigned level = (std::bit_width(deadline - now) - 1) / SlotBits;
+
+    /* past the end of the wheel, park the entry in the top level slot
+     * that will be cascaded last. it'll be re-placed from there. */
+    if (level >= NumLevels)
+      return (NumLevels - 1) * NumSlots +
+             ((now >> ((NumLevels - 1) * SlotBits)) & (NumSlots - 1));
+
+    return level * NumSlots +
+           ((deadline >> (level * SlotBits)) & (NumSlots - 1));
+  }
+
+  void link(Entry& entry)
+  {
+    entry.slot = slot_for(entry.deadline);
+    entry.prev = nullptr;
+    entry.next = slots[entry.slot];
+    if (entry.next)
+      entry.next->prev = &entry;
+    slots[entry.slot] = &entry;
+    counts[entry.slot / NumSlots]++;
+  }
+
+  void unlink(Entry& entry)
+  {
+    if (entry.prev)
+      entry.prev->next = entry.next;
+    else
+      slots[entry.slot] = entry.next;
+
+    if (entry.next)
+      entry.next->prev = entry.prev;
+
+    counts[entry.slot / NumSlots]--;
+    entry.prev = entry.next = nullptr;
+    entry.slot = -1u;
+  }
+
+  void fire(unsigned slot, std::vector<Waker>& expired)
+  {
+    while (Entry* entry = slots[slot]) {
+      unlink(*entry);
+      expired.emplace_back(std::move(*entry->waker));
+      entry->waker.reset();
+    }
+  }
+
+  /* re-places every entry of a higher level slot
+   * relative to the current tick */
+  void cascade(unsigned slot)
+  {
+    Entry* entry = slots[slot];
+    slots[slot] = nullptr;
+
+    while (entry) {
+      Entry* next = entry->next;
+      counts[slot / NumSlots]--;
+      link(*entry);
+      entry = next;
+    }
+  }
+
+  void step(std::vector<Waker>& expired)
+  {
+    now++;
+
+    for (unsigned level = NumLevels - 1; level >= 1; level--) {
+      unsigned const shift = level * SlotBits;
+      if ((now & ((std::uint64_t(1) << shift) - 1)) == 0)
+        cascade(level * NumSlots + ((now >> shift) & (NumSlots - 1)));
+    }
+
+    fire(now & (NumSlots - 1), expired);
+    fire(DueSlot, expired);
+  }
+};
+
+TimerWheel::TimerWheel()
+  : m_data(new Data) {};
+
+TimerWheel::~TimerWheel() = default;
+
+bool
+TimerWheel::insert(Entry& entry, Clock::time_point deadline, Waker waker)
+{
+  auto trans = acquire();
+
+  if (entry.slot != -1u)
+    trans->unlink(entry);
+
+  entry.deadline = trans->deadline_tick(deadline);
+  entry.waker.emplace(std::move(waker));
+  trans->link(entry);
+
+  return entry.deadline < trans->armed;
+}
+
+std::optional<Waker>
+TimerWheel::cancel(Entry& entry)
+{
+  auto trans = acquire();
+
+  if (entry.slot == -1u)
+    return std::nullopt;
+
+  trans->unlink(entry);
+  auto out = std::move(entry.waker);
+  entry.waker.reset();
+  return out;
+}
+
+bool
+TimerWheel::pending(Entry& entry)
+{
+  auto trans = acquire();
+  return entry.slot != -1u;
+}
+
+void
+TimerWheel::advance(Clock::time_point now, std::vector<Waker>& expired)
+{
+  auto trans = acquire();
+  auto const target = trans->now_tick(now);
+
+  trans->fire(Data::DueSlot, expired);
+
+  while (trans->now < target && trans->count() != 0)
+    trans->step(expired);
+
+  trans->now = std::max(trans->now, target);
+}
+
+unsigned
+TimerWheel::next_timeout(unsigned max_ms)
+{
+  auto trans = acquire();
+  unsigned timeout = max_ms;
+
+  if (trans->counts[Data::NumLevels] != 0)
+    timeout = 0;
+  else if (trans->count() != 0) {
+    /* level 0 entries expire within the next 64 ticks, which may wrap
+     * around past the end of the current group of slots */
+    unsigned const lowest = trans->now & (Data::NumSlots - 1);
+    unsigned const span = std::min(Data::NumSlots, timeout);
+    for (unsigned i = 1; i < span; i++)
+      if (trans->slots[(lowest + i) & (Data::NumSlots - 1)]) {
+        timeout = i;
+        break;
+      }
+
+    /* higher level entries may be cascaded down at the next boundary */
+    if (trans->count() != trans->counts[0])
+      timeout = std::min(timeout, Data::NumSlots - lowest);
+  }
+
+  trans->armed = trans->now + timeout;
+  return timeout;
+}
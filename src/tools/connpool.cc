@@ -0,0 +1,193 @@
+#include <cerrno>
+#include <sys/socket.h>
+
+#include "runtime.hh"
+#include "tools/connpool.hh"
+
+using namespace birdsong;
+
+/* anything readable on an idle connection is either the peer hanging up,
+ * or stray bytes that would be mistaken for the next response */
+static bool
+healthy(TCPSocket& socket)
+{
+  std::byte byte;
+  auto const ret = ::recv(socket.fd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+ConnectionPool::ConnectionPool()
+  : ConnectionPool(Config{}) {};
+
+ConnectionPool::ConnectionPool(Config config)
+  : m_config(config) {};
+
+ConnectionPool::Lease::Lease(ConnectionPool& pool,
+                             IPAddr addr,
+                             TCPSocket socket)
+  : m_pool(&pool)
+  , m_addr(addr)
+  , m_socket(std::move(socket)) {};
+
+ConnectionPool::Lease::Lease(Lease&& rhs)
+  : m_pool(rhs.m_pool)
+  , m_addr(rhs.m_addr)
+  , m_socket(std::move(rhs.m_socket))
+{
+  rhs.m_pool = nullptr;
+}
+
+auto
+ConnectionPool::Lease::operator=(Lease&& rhs) -> Lease&
+{
+  this->~Lease();
+  return *new (this) Lease(std::move(rhs));
+}
+
+ConnectionPool::Lease::~Lease()
+{
+  if (m_pool)
+    m_pool->release(m_addr, std::move(m_socket));
+}
+
+void
+ConnectionPool::Lease::discard()
+{
+  m_socket.reset();
+}
+
+void
+ConnectionPool::evict_stale(Host& host,
+                            CoarseClock::time_point cutoff,
+                            std::vector<Idle>& expired)
+{
+  unsigned stale = 0;
+  while (stale < host.idle.size() && host.idle[stale].since < cutoff)
+    expired.push_back(std::move(host.idle[stale++]));
+  host.idle.erase(host.idle.begin(), host.idle.begin() + stale);
+}
+
+auto
+ConnectionPool::claim(IPAddr addr, std::optional<TCPSocket>& idle) -> Claim
+{
+  /* declared first, so evicted sockets are closed after the lock drops */
+  std::vector<Idle> expired;
+
+  auto const cutoff = CoarseClock::now() - m_config.idle_timeout;
+  auto trans = acquire();
+  auto& host = trans->hosts.try_emplace(addr).first->second;
+
+  evict_stale(host, cutoff, expired);
+
+  if (not host.idle.empty()) {
+    idle.emplace(std::move(host.idle.back().socket));
+    host.idle.pop_back();
+    host.active++;
+    return Claim::Idle;
+  }
+
+  if (host.active < m_config.max_per_host) {
+    host.active++;
+    return Claim::Slot;
+  }
+
+  return Claim::Full;
+}
+
+void
+ConnectionPool::release(IPAddr addr, std::optional<TCPSocket> socket)
+{
+  std::optional<Waker> next;
+
+  /* dropped once the lock is released, dropping
+   * a killed task may well release a lease of its own */
+  std::vector<Waker> defunct;
+
+  {
+    auto trans = acquire();
+    auto& host = trans->hosts.at(addr);
+
+    host.active--;
+    if (socket)
+      host.idle.push_back({ std::move(*socket), CoarseClock::now() });
+
+    /* waiters that were killed or timed out would swallow the handoff,
+     * leaving the slot unclaimed whilst live waiters stay parked */
+    while (not host.waiting.empty()) {
+      Waker waker = std::move(host.waiting.front());
+      host.waiting.pop_front();
+
+      if (not waker.defunct()) {
+        next.emplace(std::move(waker));
+        break;
+      }
+
+      defunct.push_back(std::move(waker));
+    }
+  }
+
+  if (next)
+    next->wake();
+}
+
+bool
+ConnectionPool::WaitForSlot::await_suspend(std::coroutine_handle<> handle)
+{
+  auto runtime = basic_handle_from_void(handle).promise().runtime;
+
+  /* checked again under the lock,
+   * a slot may have been released since the claim failed */
+  auto trans = pool.acquire();
+  auto& host = trans->hosts.at(addr);
+  if (not host.idle.empty() || host.active < pool.m_config.max_per_host)
+    return false;
+
+  host.waiting.push_back(runtime->create_waker());
+  return true;
+}
+
+Coro<IOResult<ConnectionPool::Lease>>
+ConnectionPool::checkout(IPAddr addr)
+{
+  for (;;) {
+    std::optional<TCPSocket> idle;
+
+    switch (claim(addr, idle)) {
+      case Claim::Idle:
+        if (healthy(*idle))
+          co_return Lease(*this, addr, std::move(*idle));
+        release(addr, std::nullopt);
+        break;
+
+      case Claim::Slot: {
+        auto rt = co_await GetRuntime();
+        auto conn = co_await TCPSocket::connect(
+          *rt, addr.port(), addr.addr(), m_config.profile);
+
+        if (not conn) {
+          release(addr, std::nullopt);
+          co_return std::unexpected(ECONNREFUSED);
+        }
+
+        co_return Lease(*this, addr, std::move(*conn));
+      }
+
+      case Claim::Full:
+        co_await WaitForSlot(*this, addr);
+        break;
+    }
+  }
+}
+
+void
+ConnectionPool::evict_idle()
+{
+  std::vector<Idle> expired;
+
+  auto const cutoff = CoarseClock::now() - m_config.idle_timeout;
+  auto trans = acquire();
+
+  for (auto& [addr, host] : trans->hosts) {
+    evict_stale(host, cutoff, expired);
+  }
+}
@@ -0,0 +1,86 @@
+#include <cerrno>
+#include <expected>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "tools/eventfd.hh"
+
+using namespace birdsong;
+
+EventFd::~EventFd()
+{
+  if (m_fd != -1u)
+    close(m_fd);
+}
+
+EventFd::EventFd(EventFd&& rhs)
+  : m_fd(rhs.m_fd)
+{
+  rhs.m_fd = -1u;
+}
+
+EventFd&
+EventFd::operator=(EventFd&& rhs)
+{
+  this->~EventFd();
+  return *new (this) EventFd(std::move(rhs));
+}
+
+IOResult<EventFd>
+EventFd::create(std::uint64_t initial, bool semaphore)
+{
+  int flags = EFD_NONBLOCK | EFD_CLOEXEC;
+  if (semaphore)
+    flags |= EFD_SEMAPHORE;
+
+  /* eventfd only takes a 32 bit initial value */
+  int const fd = eventfd(0, flags);
+  if (fd < 0)
+    return std::unexpected(errno);
+
+  EventFd out(fd);
+  if (initial != 0)
+    if (auto const res = out.signal(initial); not res)
+      return std::unexpected(res.error());
+
+  return out;
+}
+
+IOResult<Empty>
+EventFd::signal(std::uint64_t n)
+{
+  if (::write(m_fd, &n, sizeof n) < 0)
+    return std::unexpected(errno);
+  return Empty{};
+}
+
+auto
+EventFd::wait() -> Wait
+{
+  return Wait(*this);
+}
+
+bool
+EventFd::Wait::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<std::uint64_t>
+EventFd::Wait::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  auto const res = take();
+  if (not res)
+    return std::unexpected(res.error());
+
+  return value;
+}
+
+long
+EventFd::Wait::attempt()
+{
+  return ::read(m_fd, &value, sizeof value);
+}
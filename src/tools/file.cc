@@ -0,0 +1,125 @@
+#include <cerrno>
+#include <expected>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tools/file.hh"
+
+using namespace birdsong;
+
+AsyncFile::AsyncFile(unsigned fd)
+  : m_fd(fd) {};
+
+AsyncFile::~AsyncFile()
+{
+  if (m_fd != -1u)
+    close(m_fd);
+}
+
+AsyncFile::AsyncFile(AsyncFile&& rhs)
+  : m_fd(rhs.m_fd)
+  , m_cursor(rhs.m_cursor)
+{
+  rhs.m_fd = -1u;
+}
+
+AsyncFile&
+AsyncFile::operator=(AsyncFile&& rhs)
+{
+  this->~AsyncFile();
+  return *new (this) AsyncFile(std::move(rhs));
+}
+
+auto
+AsyncFile::open(std::string path, int flags, mode_t mode) -> Blocking<Open>
+{
+  return Open{ std::move(path), flags, mode };
+}
+
+auto
+AsyncFile::read_at(std::span<std::byte> buf, off_t offset) -> Blocking<ReadAt>
+{
+  return ReadAt{ m_fd, buf, offset };
+}
+
+auto
+AsyncFile::write_at(std::span<std::byte const> buf, off_t offset)
+  -> Blocking<WriteAt>
+{
+  return WriteAt{ m_fd, buf, offset };
+}
+
+auto
+AsyncFile::read(std::span<std::byte> buf) -> Blocking<ReadAt>
+{
+  return ReadAt{ m_fd, buf, 0, &m_cursor };
+}
+
+auto
+AsyncFile::write(std::span<std::byte const> buf) -> Blocking<WriteAt>
+{
+  return WriteAt{ m_fd, buf, 0, &m_cursor };
+}
+
+auto
+AsyncFile::fsync(bool data_only) -> Blocking<Sync>
+{
+  return Sync{ m_fd, data_only };
+}
+
+auto
+AsyncFile::fallocate(off_t offset, off_t len, int mode) -> Blocking<Allocate>
+{
+  return Allocate{ m_fd, mode, offset, len };
+}
+
+IOResult<AsyncFile>
+AsyncFile::Open::operator()() const
+{
+  int const fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+  if (fd < 0)
+    return std::unexpected(errno);
+  return AsyncFile(fd);
+}
+
+IOResult<unsigned>
+AsyncFile::ReadAt::operator()() const
+{
+  off_t const at = cursor ? *cursor : offset;
+  auto const ret = ::pread(fd, buf.data(), buf.size_bytes(), at);
+  if (ret < 0)
+    return std::unexpected(errno);
+
+  if (cursor)
+    *cursor += ret;
+  return ret;
+}
+
+IOResult<unsigned>
+AsyncFile::WriteAt::operator()() const
+{
+  off_t const at = cursor ? *cursor : offset;
+  auto const ret = ::pwrite(fd, buf.data(), buf.size_bytes(), at);
+  if (ret < 0)
+    return std::unexpected(errno);
+
+  if (cursor)
+    *cursor += ret;
+  return ret;
+}
+
+IOResult<Empty>
+AsyncFile::Sync::operator()() const
+{
+  if ((data_only ? ::fdatasync(fd) : ::fsync(fd)) < 0)
+    return std::unexpected(errno);
+  return Empty{};
+}
+
+IOResult<Empty>
+AsyncFile::Allocate::operator()() const
+{
+  if (::fallocate(fd, mode, offset, len) < 0)
+    return std::unexpected(errno);
+  return Empty{};
+}
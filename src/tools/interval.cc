@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <chrono>
+
+#include "common.hh"
+#include "coro.hh"
+#include "runtime.hh"
+#include "task.hh"
+#include "timer.hh"
+#include "tools/interval.hh"
+
+using namespace birdsong;
+
+Interval::Interval(unsigned ms, MissedTick policy)
+  : m_period(std::chrono::milliseconds(std::max(ms, 1u)))
+  , m_next(TimerWheel::Clock::now() + m_period)
+  , m_policy(policy) {};
+
+Interval::~Interval()
+{
+  if (m_runtime)
+    m_runtime->timers().cancel(m_entry);
+}
+
+void
+Interval::reset()
+{
+  m_next = TimerWheel::Clock::now() + m_period;
+
+  if (not m_runtime)
+    return;
+
+  if (auto waker = m_runtime->timers().cancel(m_entry))
+    m_runtime->timer_insert(m_entry, m_next, std::move(*waker));
+}
+
+bool
+Interval::await_ready()
+{
+  return TimerWheel::Clock::now() >= m_next;
+}
+
+bool
+Interval::await_suspend(std::coroutine_handle<> handle)
+{
+  m_runtime = basic_handle_from_void(handle).promise().runtime;
+  m_runtime->timer_insert(m_entry, m_next, m_runtime->create_waker());
+  return true;
+}
+
+TimerWheel::Clock::time_point
+Interval::await_resume()
+{
+  auto const now = TimerWheel::Clock::now();
+  auto const scheduled = m_next;
+
+  m_next = scheduled + m_period;
+
+  /* only a tick that is already overdue counts as missed */
+  if (m_next > now)
+    return scheduled;
+
+  switch (m_policy) {
+    case MissedTick::Burst:
+      break;
+
+    case MissedTick::Delay:
+      m_next = now + m_period;
+      break;
+
+    case MissedTick::Skip:
+      m_next += ((now - m_next) / m_period + 1) * m_period;
+      break;
+  }
+
+  return scheduled;
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "runtime.hh"
+#include "tools/mmap.hh"
+
+using namespace birdsong;
+
+static std::size_t const PageSize = sysconf(_SC_PAGESIZE);
+
+/* true if every page overlapping the range is in memory */
+static bool
+resident(std::span<std::byte const> range)
+{
+  if (range.empty())
+    return true;
+
+  auto const start = reinterpret_cast<std::uintptr_t>(range.data());
+  auto const first = start & ~(PageSize - 1);
+  auto const len = start + range.size_bytes() - first;
+  auto const pages = (len + PageSize - 1) / PageSize;
+
+  /* reads are generally a handful of pages, so this stays on the stack */
+  unsigned char small[16];
+  std::vector<unsigned char> large;
+  unsigned char* vec = small;
+  if (pages > sizeof small) {
+    large.resize(pages);
+    vec = large.data();
+  }
+
+  if (mincore(reinterpret_cast<void*>(first), len, vec) < 0)
+    return false;
+
+  return std::all_of(vec, vec + pages, [](auto page) { return page & 1; });
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    munmap(const_cast<std::byte*>(m_data), m_size);
+}
+
+MappedFile::MappedFile(MappedFile&& rhs)
+  : m_data(rhs.m_data)
+  , m_size(rhs.m_size)
+  , m_cursor(rhs.m_cursor)
+{
+  rhs.m_data = nullptr;
+}
+
+MappedFile&
+MappedFile::operator=(MappedFile&& rhs)
+{
+  this->~MappedFile();
+  return *new (this) MappedFile(std::move(rhs));
+}
+
+auto
+MappedFile::open(std::string path) -> Blocking<Open>
+{
+  return Open{ std::move(path) };
+}
+
+std::span<std::byte const>
+MappedFile::view(std::size_t offset, std::size_t len) const
+{
+  offset = std::min(offset, m_size);
+  return { m_data + offset, std::min(len, m_size - offset) };
+}
+
+auto
+MappedFile::prefetch(std::size_t offset, std::size_t len) -> Blocking<Prefetch>
+{
+  return Prefetch{ view(offset, len) };
+}
+
+auto
+MappedFile::read(std::span<std::byte> buf) -> Read
+{
+  return Read(*this, buf);
+}
+
+unsigned
+MappedFile::copy_out(std::span<std::byte> out)
+{
+  auto const in = view(m_cursor, out.size_bytes());
+  std::memcpy(out.data(), in.data(), in.size_bytes());
+  m_cursor += in.size_bytes();
+  return in.size_bytes();
+}
+
+IOResult<MappedFile>
+MappedFile::Open::operator()() const
+{
+  int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::unexpected(errno);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int const err = errno;
+    close(fd);
+    return std::unexpected(err);
+  }
+
+  /* empty files can't be mapped, they just have no bytes */
+  if (st.st_size == 0) {
+    close(fd);
+    return MappedFile(nullptr, 0);
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  /* the mapping keeps the file alive by itself */
+  int const err = errno;
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return std::unexpected(err);
+
+  return MappedFile(static_cast<std::byte const*>(data), st.st_size);
+}
+
+IOResult<Empty>
+MappedFile::Prefetch::operator()() const
+{
+  if (range.empty())
+    return Empty{};
+
+  auto const start = reinterpret_cast<std::uintptr_t>(range.data());
+  auto const first = start & ~(PageSize - 1);
+  auto const len = start + range.size_bytes() - first;
+
+  /* start readahead on the whole range at once, rather than
+   * faulting it in a page at a time below */
+  if (madvise(reinterpret_cast<void*>(first), len, MADV_WILLNEED) < 0)
+    return std::unexpected(errno);
+
+  /* madvise only starts the io, touching every page waits for it */
+  for (auto page = first; page < start + range.size_bytes(); page += PageSize)
+    (void)*reinterpret_cast<std::byte const volatile*>(std::max(page, start));
+
+  return Empty{};
+}
+
+bool
+MappedFile::Read::await_ready()
+{
+  if (not resident(file.view(file.m_cursor, buf.size_bytes())))
+    return false;
+
+  m_copied = file.copy_out(buf);
+  return true;
+}
+
+void
+MappedFile::Read::await_suspend(std::coroutine_handle<> handle)
+{
+  auto rt = basic_handle_from_void(handle).promise().runtime;
+
+  blocking_pool().push_task([this, waker = rt->create_waker()]() mutable {
+    m_copied = file.copy_out(buf);
+    waker.wake();
+  });
+}
@@ -0,0 +1,195 @@
+#include <cerrno>
+#include <expected>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "tools/pipe.hh"
+
+using namespace birdsong;
+
+Pipe::Pipe(int read_fd, int write_fd)
+  : m_fds{ read_fd, write_fd }
+  , m_capacity(fcntl(write_fd, F_GETPIPE_SZ)) {};
+
+Pipe::~Pipe()
+{
+  if (m_fds[0] != -1)
+    close(m_fds[0]);
+  if (m_fds[1] != -1)
+    close(m_fds[1]);
+}
+
+Pipe::Pipe(Pipe&& rhs)
+  : m_fds{ rhs.m_fds[0], rhs.m_fds[1] }
+  , m_capacity(rhs.m_capacity)
+{
+  rhs.m_fds[0] = rhs.m_fds[1] = -1;
+}
+
+Pipe&
+Pipe::operator=(Pipe&& rhs)
+{
+  this->~Pipe();
+  return *new (this) Pipe(std::move(rhs));
+}
+
+IOResult<Pipe>
+Pipe::create()
+{
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    return std::unexpected(errno);
+  return Pipe(fds[0], fds[1]);
+}
+
+auto
+Pipe::read(std::span<std::byte> buf) -> Read
+{
+  return Read(*this, buf);
+}
+
+auto
+Pipe::write(std::span<std::byte const> buf) -> Write
+{
+  return Write(*this, buf);
+}
+
+auto
+Pipe::splice_from(unsigned fd, std::size_t len) -> Splice
+{
+  return Splice(*this, fd, len, true);
+}
+
+auto
+Pipe::splice_to(unsigned fd, std::size_t len) -> Splice
+{
+  return Splice(*this, fd, len, false);
+}
+
+IOResult<Empty>
+Pipe::set_capacity(unsigned bytes)
+{
+  int const res = fcntl(m_fds[1], F_SETPIPE_SZ, bytes);
+  if (res < 0)
+    return std::unexpected(errno);
+
+  /* the kernel rounds up to a power of two pages */
+  m_capacity = res;
+  return Empty{};
+}
+
+void
+Pipe::close_write()
+{
+  if (m_fds[1] != -1)
+    close(m_fds[1]), m_fds[1] = -1;
+}
+
+bool
+Pipe::Read::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+Pipe::Read::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+Pipe::Read::attempt()
+{
+  return ::read(m_fd, buf.data(), buf.size_bytes());
+}
+
+bool
+Pipe::Write::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+Pipe::Write::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+Pipe::Write::attempt()
+{
+  return ::write(m_fd, buf.data(), buf.size_bytes());
+}
+
+Pipe::Splice::Splice(Pipe& pipe,
+                     unsigned other,
+                     std::size_t len,
+                     bool into_pipe)
+  : SpeculativeIO(other, { into_pipe, not into_pipe })
+  , pipe(pipe)
+  , other(other)
+  , len(len)
+  , into_pipe(into_pipe) {};
+
+bool
+Pipe::Splice::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+Pipe::Splice::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+Pipe::Splice::attempt()
+{
+  constexpr unsigned Flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+  long const res =
+    into_pipe
+      ? ::splice(other, nullptr, pipe.m_fds[1], nullptr, len, Flags)
+      : ::splice(pipe.m_fds[0], nullptr, other, nullptr, len, Flags);
+
+  if (res >= 0 || errno != EAGAIN)
+    return res;
+
+  /* work out which end blocked, so the reactor is waited on for the
+   * right one. a pipe runs out of slots, one page each, long before
+   * its byte count reaches capacity, so filling it is judged by the
+   * source having bytes that couldn't be moved rather than by how many
+   * are queued. sources without FIONREAD are assumed to have bytes
+   * whenever the pipe isn't empty */
+  int queued = 0;
+  ioctl(pipe.m_fds[0], FIONREAD, &queued);
+
+  bool pipe_blocked = queued == 0;
+
+  if (into_pipe) {
+    int avail = 0;
+    pipe_blocked = ioctl(other, FIONREAD, &avail) == 0 ? avail > 0 : queued > 0;
+  }
+
+  if (pipe_blocked) {
+    m_fd = pipe.m_fds[into_pipe ? 1 : 0];
+    m_mask = { not into_pipe, into_pipe };
+  } else {
+    m_fd = other;
+    m_mask = { into_pipe, not into_pipe };
+  }
+
+  errno = EAGAIN;
+  return res;
+}
@@ -0,0 +1,190 @@
+#include <atomic>
+#include <cerrno>
+#include <sys/socket.h>
+
+#include "clock.hh"
+#include "runtime.hh"
+#include "tools/pipe.hh"
+#include "tools/proxy.hh"
+#include "tools/timeout.hh"
+
+using namespace birdsong;
+
+namespace {
+
+/* shared by both directions, activity in either keeps the proxy alive */
+struct ProxyState
+{
+  ProxyState(ProxyConfig const& config)
+    : config(config)
+  {
+    touch();
+  }
+
+  void touch()
+  {
+    last_active.store(CoarseClock::now().time_since_epoch().count(),
+                      std::memory_order_relaxed);
+  }
+
+  CoarseClock::time_point deadline() const
+  {
+    if (config.idle_timeout == config.idle_timeout.zero())
+      return CoarseClock::time_point::max();
+
+    return CoarseClock::time_point(CoarseClock::duration(
+             last_active.load(std::memory_order_relaxed))) +
+           config.idle_timeout;
+  }
+
+  /* a wait timing out only means this direction was idle */
+  bool expired() const { return CoarseClock::now() >= deadline(); }
+
+  ProxyConfig const& config;
+  std::atomic<CoarseClock::rep> last_active;
+};
+
+};
+
+/* returns EINVAL only if the sockets can't be spliced and nothing was
+ * ever spliced into the pipe, so falling back loses no bytes. once
+ * something has gone in, an EINVAL is reported as EIO instead */
+static Coro<IOResult<Empty>>
+splice_one_way(ProxyState& state,
+               TCPSocket& from,
+               TCPSocket& to,
+               std::atomic<std::uint64_t>& counter)
+{
+  constexpr unsigned Chunk = 1 << 16;
+
+  auto pipe = Pipe::create();
+  if (not pipe)
+    co_return std::unexpected(pipe.error());
+
+  bool spliced_in = false;
+  auto const fail = [&](Errno err) {
+    return std::unexpected(err == EINVAL && spliced_in ? EIO : err);
+  };
+
+  for (;;) {
+    auto const in = co_await with_deadline(
+      pipe->splice_from(from.fd(), Chunk), state.deadline());
+
+    if (not in && in.error() == ETIMEDOUT && not state.expired())
+      continue;
+    if (not in)
+      co_return fail(in.error());
+    if (*in == 0)
+      break;
+
+    spliced_in = true;
+    state.touch();
+
+    /* the pipe is drained before reading any more,
+     * which is what pushes back on a fast reader */
+    for (unsigned left = *in; left != 0;) {
+      auto const out = co_await with_deadline(
+        pipe->splice_to(to.fd(), left), state.deadline());
+
+      if (not out && out.error() == ETIMEDOUT && not state.expired())
+        continue;
+      if (not out)
+        co_return fail(out.error());
+
+      left -= *out;
+      counter.fetch_add(*out, std::memory_order_relaxed);
+      state.touch();
+    }
+  }
+
+  co_return Empty{};
+}
+
+static Coro<IOResult<Empty>>
+copy_one_way(ProxyState& state,
+             TCPSocket& from,
+             TCPSocket& to,
+             std::atomic<std::uint64_t>& counter)
+{
+  auto& pool = state.config.pool ? *state.config.pool : BufferPool::shared();
+
+  for (;;) {
+    /* a buffer is only held whilst there are bytes in flight */
+    auto const in =
+      co_await with_deadline(from.read_borrowed(pool), state.deadline());
+
+    if (not in && in.error() == ETIMEDOUT && not state.expired())
+      continue;
+    if (not in)
+      co_return std::unexpected(in.error());
+    if (in->len == 0)
+      break;
+
+    state.touch();
+
+    for (auto bytes = in->bytes(); not bytes.empty();) {
+      auto const out =
+        co_await with_deadline(to.write(bytes), state.deadline());
+
+      if (not out && out.error() == ETIMEDOUT && not state.expired())
+        continue;
+      if (not out)
+        co_return std::unexpected(out.error());
+
+      bytes = bytes.subspan(*out);
+      counter.fetch_add(*out, std::memory_order_relaxed);
+      state.touch();
+    }
+  }
+
+  co_return Empty{};
+}
+
+static Coro<IOResult<Empty>>
+proxy_one_way(ProxyState& state,
+              TCPSocket& from,
+              TCPSocket& to,
+              std::atomic<std::uint64_t>& counter)
+{
+  IOResult<Empty> res = std::unexpected(EINVAL);
+
+  if (state.config.use_splice)
+    res = co_await splice_one_way(state, from, to, counter);
+
+  if (not res && res.error() == EINVAL)
+    res = co_await copy_one_way(state, from, to, counter);
+
+  /* on an error both sockets are shut down, which wakes the other
+   * direction wherever it is parked instead of leaving it to wait */
+  if (res)
+    shutdown(to.fd(), SHUT_WR);
+  else
+    shutdown(from.fd(), SHUT_RDWR), shutdown(to.fd(), SHUT_RDWR);
+
+  co_return std::move(res);
+}
+
+Coro<IOResult<Transferred>>
+birdsong::proxy(TCPSocket& a,
+                TCPSocket& b,
+                ProxyConfig const& config,
+                ProxyStats* stats)
+{
+  ProxyStats local;
+  auto& counters = stats ? *stats : local;
+  ProxyState state(config);
+
+  auto rt = co_await GetRuntime();
+  auto backward = rt->spawn(proxy_one_way(state, b, a, counters.b_to_a));
+  auto const forward =
+    co_await proxy_one_way(state, a, b, counters.a_to_b);
+  auto const back = co_await backward;
+
+  if (not back)
+    co_return std::unexpected(back.error());
+
+  if (not forward)
+    co_return std::unexpected(forward.error());
+
+  co_return Transferred{ counters.a_to_b.load(), counters.b_to_a.load() };
+}
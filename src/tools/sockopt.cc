@@ -0,0 +1,68 @@
+#include "tools/sockopt.hh"
+
+using namespace birdsong;
+
+template<typename Opt>
+static IOResult<Empty>
+set_if(unsigned fd, std::optional<typename Opt::Value> const& value)
+{
+  if (not value)
+    return Empty{};
+  return set_option<Opt>(fd, *value);
+}
+
+SocketProfile
+SocketProfile::low_latency()
+{
+  SocketProfile out;
+  out.no_delay = true;
+  out.quick_ack = true;
+  out.busy_poll_us = 50;
+  return out;
+}
+
+SocketProfile
+SocketProfile::throughput()
+{
+  SocketProfile out;
+  out.no_delay = false;
+  out.send_buffer = 4 << 20;
+  out.recv_buffer = 4 << 20;
+  return out;
+}
+
+IOResult<Empty>
+SocketProfile::apply(unsigned fd) const
+{
+  IOResult<Empty> res = Empty{};
+
+  if (res)
+    res = set_if<sockopt::SendBuffer>(fd, send_buffer);
+  if (res)
+    res = set_if<sockopt::RecvBuffer>(fd, recv_buffer);
+  if (res)
+    res = set_if<sockopt::NoDelay>(fd, no_delay);
+  if (res)
+    res = set_if<sockopt::QuickAck>(fd, quick_ack);
+  if (res)
+    res = set_if<sockopt::Cork>(fd, cork);
+  if (res)
+    res = set_if<sockopt::BusyPoll>(fd, busy_poll_us);
+
+  return res;
+}
+
+IOResult<Empty>
+SocketProfile::apply_listener(unsigned fd) const
+{
+  IOResult<Empty> res = Empty{};
+
+  if (res)
+    res = set_if<sockopt::SendBuffer>(fd, send_buffer);
+  if (res)
+    res = set_if<sockopt::RecvBuffer>(fd, recv_buffer);
+  if (res)
+    res = set_if<sockopt::DeferAccept>(fd, defer_accept_s);
+
+  return res;
+}
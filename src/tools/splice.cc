@@ -0,0 +1,43 @@
+#include <cerrno>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "coro.hh"
+#include "io.hh"
+#include "runtime.hh"
+#include "tools/proxy.hh"
+#include "tools/splice.hh"
+#include "tools/tcp.hh"
+
+using namespace birdsong;
+
+Coro<IOResult<std::size_t>>
+birdsong::sendfile(unsigned file_fd,
+                   TCPSocket& socket,
+                   off_t offset,
+                   std::size_t len)
+{
+  std::size_t sent = 0;
+
+  while (sent != len) {
+    auto const res = ::sendfile(socket.fd(), file_fd, &offset, len - sent);
+
+    if (res > 0)
+      sent += res;
+    else if (res == 0)
+      break;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      co_await FDReady(socket.fd(), { false, true });
+    else if (errno != EINTR)
+      co_return std::unexpected(errno);
+  }
+
+  co_return sent;
+}
+
+Coro<IOResult<Transferred>>
+birdsong::copy_bidirectional(TCPSocket& a, TCPSocket& b)
+{
+  co_return co_await proxy(a, b);
+}
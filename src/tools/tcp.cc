@@ -1,10 +1,12 @@
 #include <arpa/inet.h>
+#include <array>
 #include <asm-generic/socket.h>
 #include <compare>
 #include <coroutine>
 #include <cstring>
 #include <expected>
 #include <format>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
 #include <optional>
 #include <poll.h>
@@ -19,16 +21,11 @@
 
 using namespace birdsong;
 
-static void
-setnonblock(unsigned fd)
+TCPListener::TCPListener(unsigned short port,
+                         unsigned queue_size,
+                         bool reuse_port)
 {
-  static unsigned val = true;
-  setsockopt(fd, SOL_SOCKET, SOCK_NONBLOCK, &val, sizeof val);
-}
-
-TCPListener::TCPListener(unsigned short port, unsigned queue_size)
-{
-  m_fd = socket(AF_INET, SOCK_STREAM, 0);
+  m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
   if (m_fd == -1u)
     throw std::runtime_error("unable to create tcp listener");
@@ -36,6 +33,11 @@ TCPListener::TCPListener(unsigned short port, unsigned queue_size)
   int val = 1;
   setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val);
 
+  if (reuse_port &&
+      setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof val) < 0)
+    throw std::runtime_error(
+      std::format("unable to set SO_REUSEPORT {}", strerror(errno)));
+
   struct sockaddr_in addr;
   addr.sin_addr.s_addr = htonl(INADDR_ANY);
   addr.sin_port = htons(port);
@@ -57,7 +59,8 @@ TCPListener::~TCPListener()
 }
 
 TCPListener::AcceptAwaiter::AcceptAwaiter(TCPListener& listener)
-  : listener(listener) {};
+  : SpeculativeIO(listener.m_fd, { true, false })
+  , listener(listener) {};
 
 auto
 TCPListener::accept() -> AcceptAwaiter
@@ -68,42 +71,168 @@ TCPListener::accept() -> AcceptAwaiter
 bool
 TCPListener::AcceptAwaiter::await_ready()
 {
-  /* do an in-place non-blocking poll to check if
-   * the socket already has an incoming connection,
-   * if so just continue the coroutine */
-  struct pollfd pfd;
-  pfd.fd = listener.m_fd;
-  pfd.events = 0 | POLLIN;
-
-  if (poll(&pfd, 1, 0) < 0)
-    throw std::runtime_error("fatal poll error");
-
-  return pfd.revents & POLLIN;
+  /* the listener is non-blocking, so just try to accept
+   * in place. if theres nothing pending, wait on the reactor */
+  return settle(attempt());
 }
 
-void
-TCPListener::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle)
+long
+TCPListener::AcceptAwaiter::attempt()
 {
-  auto rt = basic_handle_from_void(handle).promise().runtime;
-  Reactor& reactor = rt->get_reactor();
-  reactor.insert(
-    Reactor::FDWait{ rt->create_waker(), listener.m_fd, { true, false } });
+  /* accepted sockets come out non-blocking already,
+   * saving a pair of fcntl calls per connection */
+  socklen_t size = sizeof(m_addr);
+  return ::accept4(listener.m_fd,
+                   (struct sockaddr*)&m_addr,
+                   &size,
+                   SOCK_NONBLOCK | SOCK_CLOEXEC);
 }
 
 std::optional<TCPSocket>
 TCPListener::AcceptAwaiter::await_resume()
 {
-  int incoming_fd;
-  struct sockaddr_in addr;
-  socklen_t size = sizeof(addr);
+  if (not m_result)
+    settle(attempt());
 
-  if ((incoming_fd = ::accept(listener.m_fd, (struct sockaddr*)&addr, &size)) ==
-      -1)
+  auto const res = take();
+  if (not res)
     return std::nullopt;
-  setnonblock(incoming_fd);
 
-  return TCPSocket(incoming_fd,
-                   IPAddr(ntohl(addr.sin_addr.s_addr), ntohs(addr.sin_port)));
+  listener.m_profile.apply(*res);
+
+  return TCPSocket(
+    *res, IPAddr(ntohl(m_addr.sin_addr.s_addr), ntohs(m_addr.sin_port)));
+}
+
+/* accepts until max connections are in out or the backlog is empty.
+ * returns the errno of a hard failure, if one cut the drain short */
+static std::optional<unsigned>
+accept_pending(unsigned fd,
+               SocketProfile const& profile,
+               std::vector<TCPSocket>& out,
+               unsigned max)
+{
+  while (out.size() < max) {
+    struct sockaddr_in addr;
+    socklen_t size = sizeof(addr);
+    int const conn = ::accept4(
+      fd, (struct sockaddr*)&addr, &size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (conn >= 0) {
+      profile.apply(conn);
+      out.emplace_back(
+        conn, IPAddr(ntohl(addr.sin_addr.s_addr), ntohs(addr.sin_port)));
+      continue;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+
+    /* the peer gave up before we got to it, the rest
+     * of the backlog is still good */
+    if (errno == ECONNABORTED || errno == EINTR)
+      continue;
+
+    return errno;
+  }
+
+  return std::nullopt;
+}
+
+IOResult<Empty>
+TCPListener::set_profile(SocketProfile const& profile)
+{
+  m_profile = profile;
+  return m_profile.apply_listener(m_fd);
+}
+
+std::vector<TCPSocket>
+TCPListener::shutdown()
+{
+  std::vector<TCPSocket> out;
+  accept_pending(m_fd, m_profile, out, -1u);
+
+  /* shutting down a listening socket takes it out of its reuseport
+   * group & wakes anything polling it, without freeing up the fd
+   * number for reuse under the feet of a waiting accept */
+  ::shutdown(m_fd, SHUT_RDWR);
+  return out;
+}
+
+ShardedListener::ShardedListener(unsigned short port,
+                                 unsigned num_shards,
+                                 unsigned queue_size,
+                                 SocketProfile const& profile)
+  : m_port(port)
+  , m_queueSize(queue_size)
+  , m_profile(profile)
+{
+  for (unsigned i = 0; i < num_shards; i++)
+    add_shard();
+}
+
+auto
+ShardedListener::add_shard() -> Shard
+{
+  auto shard = std::make_shared<TCPListener>(m_port, m_queueSize, true);
+  shard->set_profile(m_profile);
+  acquire()->shards.push_back(shard);
+  return shard;
+}
+
+std::vector<TCPSocket>
+ShardedListener::remove_shard(Shard const& shard)
+{
+  {
+    auto trans = acquire();
+    std::erase(trans->shards, shard);
+  }
+
+  return shard->shutdown();
+}
+
+auto
+ShardedListener::shards() -> std::vector<Shard>
+{
+  return acquire()->shards;
+}
+
+TCPListener::AcceptBatchAwaiter::AcceptBatchAwaiter(TCPListener& listener,
+                                                    unsigned max)
+  : FDReady(listener.m_fd, { true, false })
+  , listener(listener)
+  , m_max(max) {};
+
+auto
+TCPListener::accept_batch(unsigned max) -> AcceptBatchAwaiter
+{
+  return { *this, max };
+}
+
+bool
+TCPListener::AcceptBatchAwaiter::drain()
+{
+  m_error =
+    accept_pending(listener.m_fd, listener.m_profile, m_accepted, m_max);
+  return not m_accepted.empty() || m_error;
+}
+
+bool
+TCPListener::AcceptBatchAwaiter::await_ready()
+{
+  return drain();
+}
+
+IOResult<std::vector<TCPSocket>>
+TCPListener::AcceptBatchAwaiter::await_resume()
+{
+  if (m_accepted.empty() && not m_error)
+    drain();
+
+  if (not m_accepted.empty())
+    return std::move(m_accepted);
+
+  return std::unexpected(m_error.value_or(EAGAIN));
 }
 
 TCPSocket::TCPSocket(unsigned fd, IPAddr addr)
@@ -119,6 +248,9 @@ TCPSocket::~TCPSocket()
 TCPSocket::TCPSocket(TCPSocket&& rhs)
   : m_fd(rhs.m_fd)
   , m_addr(rhs.m_addr)
+  , m_zcSent(rhs.m_zcSent)
+  , m_zcDone(rhs.m_zcDone)
+  , m_zcEnabled(rhs.m_zcEnabled)
 {
   rhs.m_fd = -1u;
 }
@@ -130,9 +262,21 @@ TCPSocket::operator=(TCPSocket&& rhs)
 }
 
 auto
-TCPSocket::connect(Runtime&, unsigned short port, uint32_t address) -> Connect
+TCPSocket::connect(Runtime&,
+                   unsigned short port,
+                   uint32_t address,
+                   SocketProfile const& profile) -> Connect
 {
-  return Connect{ -1u, address, port };
+  return Connect{ -1u, address, port, profile };
+}
+
+IOResult<Empty>
+TCPSocket::uncork()
+{
+  /* the kernel flushes held back frames as soon as cork is cleared */
+  if (auto const res = set<sockopt::Cork>(false); not res)
+    return res;
+  return set<sockopt::Cork>(true);
 }
 
 auto
@@ -147,99 +291,282 @@ TCPSocket::write(std::span<std::byte const> buffer) -> Write
   return Write(*this, buffer);
 }
 
+auto
+TCPSocket::read_vectored(std::span<std::span<std::byte> const> buffers)
+  -> ReadVectored
+{
+  return ReadVectored(*this, buffers);
+}
+
+auto
+TCPSocket::write_vectored(std::span<std::span<std::byte const> const> buffers)
+  -> WriteVectored
+{
+  return WriteVectored(*this, buffers);
+}
+
 IPAddr const&
 TCPSocket::addr() const
 {
   return m_addr;
 }
 
+/* read & write both attempt the syscall before going to the reactor.
+ * MSG_DONTWAIT keeps them non-blocking regardless of the fd flags */
+
 bool
 TCPSocket::Read::await_ready()
 {
-  struct pollfd pfd;
-  pfd.fd = socket.m_fd;
-  pfd.events = POLLIN;
-  return poll(&pfd, 1, 0) != 0;
+  return settle(attempt());
 }
 
-void
-TCPSocket::Read::await_suspend(std::coroutine_handle<> handle)
+long
+TCPSocket::Read::attempt()
 {
-  auto rt = basic_handle_from_void(handle).promise().runtime;
-  rt->get_reactor().insert(
-    { rt->create_waker(), socket.m_fd, { true, false } });
+  return ::recv(m_fd, buf.data(), buf.size(), MSG_DONTWAIT);
 }
 
 std::expected<unsigned, unsigned>
 TCPSocket::Read::await_resume()
 {
-  unsigned val = ::recv(socket.m_fd, buf.data(), buf.size(), 0);
+  if (not m_result)
+    settle(attempt());
 
-  if (val == -1u)
-    return std::unexpected(errno);
-  else
-    return val;
+  return take();
 }
 
 bool
 TCPSocket::Write::await_ready()
 {
-  struct pollfd pfd;
-  pfd.fd = socket.m_fd;
-  pfd.events = POLLOUT;
-  return poll(&pfd, 1, 0) != 0;
+  return settle(attempt());
 }
 
-void
-TCPSocket::Write::await_suspend(std::coroutine_handle<> handle)
+long
+TCPSocket::Write::attempt()
 {
-  auto rt = basic_handle_from_void(handle).promise().runtime;
-  rt->get_reactor().insert(
-    { rt->create_waker(), socket.m_fd, { false, true } });
+  /* SIGPIPE is weird and ugly. don't send it. */
+  return ::send(m_fd, buf.data(), buf.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
 }
 
 std::expected<unsigned, unsigned>
 TCPSocket::Write::await_resume()
 {
-  /* SIGPIPE is weird and ugly. don't send it. */
-  unsigned val = ::send(socket.m_fd, buf.data(), buf.size(), MSG_NOSIGNAL);
+  if (not m_result)
+    settle(attempt());
 
-  if (val == -1u)
-    return std::unexpected(errno);
-  else
-    return val;
+  return take();
+}
+
+/* vectored io goes through recvmsg/sendmsg rather than readv/writev
+ * so that the same per-call flags can be passed */
+
+bool
+TCPSocket::ReadVectored::await_ready()
+{
+  return settle(attempt());
+}
+
+long
+TCPSocket::ReadVectored::attempt()
+{
+  std::array<iovec, MaxIOVecs> iovs;
+  struct msghdr msg{};
+  msg.msg_iov = iovs.data();
+  msg.msg_iovlen = to_iovecs(bufs, iovs);
+  return ::recvmsg(m_fd, &msg, MSG_DONTWAIT);
+}
+
+IOResult<unsigned>
+TCPSocket::ReadVectored::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+bool
+TCPSocket::WriteVectored::await_ready()
+{
+  return settle(attempt());
+}
+
+long
+TCPSocket::WriteVectored::attempt()
+{
+  std::array<iovec, MaxIOVecs> iovs;
+  struct msghdr msg{};
+  msg.msg_iov = iovs.data();
+  msg.msg_iovlen = to_iovecs(bufs, iovs);
+  return ::sendmsg(m_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+IOResult<unsigned>
+TCPSocket::WriteVectored::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+bool
+TCPSocket::ZerocopyWrite::await_ready()
+{
+  return settle(attempt());
+}
+
+long
+TCPSocket::ZerocopyWrite::attempt()
+{
+  return ::send(m_fd,
+                buf.data(),
+                buf.size(),
+                MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ZEROCOPY);
+}
+
+IOResult<unsigned>
+TCPSocket::ZerocopyWrite::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+IOResult<Empty>
+TCPSocket::reap_zerocopy()
+{
+  for (;;) {
+    char control[128];
+    struct msghdr msg{};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    if (::recvmsg(m_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return Empty{};
+      return std::unexpected(errno);
+    }
+
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR)
+        continue;
+
+      auto const* err = (struct sock_extended_err const*)CMSG_DATA(cm);
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      /* each notification covers an inclusive range of sends */
+      m_zcDone += err->ee_data - err->ee_info + 1;
+    }
+  }
+}
+
+Coro<IOResult<unsigned>>
+TCPSocket::write_zerocopy(std::span<std::byte const> buffer)
+{
+  if (not m_zcEnabled) {
+    int val = 1;
+    if (setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof val) < 0)
+      co_return std::unexpected(errno);
+    m_zcEnabled = true;
+  }
+
+  unsigned idx = 0;
+  std::optional<Errno> error;
+
+  while (idx != buffer.size_bytes()) {
+    auto const res = co_await ZerocopyWrite(*this, buffer.subspan(idx));
+
+    if (res) {
+      if (*res == 0)
+        break;
+
+      idx += *res;
+      m_zcSent++;
+      continue;
+    }
+
+    /* completions queueing up raise POLLERR, which wakes the write
+     * early. drain them so the next wait is on real writability */
+    if (res.error() == EAGAIN) {
+      if (auto const reaped = reap_zerocopy(); not reaped) {
+        error = reaped.error();
+        break;
+      }
+      continue;
+    }
+
+    /* ENOBUFS means too many pages are pinned by earlier sends,
+     * so wait for the kernel to let go of some of them first */
+    if (res.error() != ENOBUFS || m_zcDone == m_zcSent) {
+      error = res.error();
+      break;
+    }
+
+    std::uint32_t const done = m_zcDone;
+    while (done == m_zcDone && not error) {
+      if (auto const reaped = reap_zerocopy(); not reaped)
+        error = reaped.error();
+      else if (done == m_zcDone)
+        co_await FDReady(m_fd, { false, false });
+    }
+
+    if (error)
+      break;
+  }
+
+  /* the buffer is still owned by the kernel until every send has been
+   * reported back as complete, so this waits them out even after a
+   * send has failed. only a failure to reap at all cuts it short */
+  while (m_zcDone != m_zcSent) {
+    auto const reaped = reap_zerocopy();
+    if (not reaped) {
+      error = error.value_or(reaped.error());
+      break;
+    }
+    if (m_zcDone != m_zcSent)
+      co_await FDReady(m_fd, { false, false });
+  }
+
+  if (error)
+    co_return std::unexpected(*error);
+
+  co_return idx;
 }
 
 bool
 TCPSocket::Connect::await_ready()
 {
-  m_fd = socket(AF_INET, SOCK_STREAM, 0);
+  m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
   /* failure to create a socket in the first place is pretty exceptional */
   if (m_fd == -1u)
     throw std::runtime_error("unable to create tcp socket\n");
 
-  setnonblock(m_fd);
+  m_profile.apply(m_fd);
+
   struct sockaddr_in addr{};
   addr.sin_addr.s_addr = htonl(m_addr);
   addr.sin_port = htons(m_port);
   addr.sin_family = AF_INET;
-  if (::connect(m_fd, (struct sockaddr*)&addr, sizeof addr) < 0)
+  if (::connect(m_fd, (struct sockaddr*)&addr, sizeof addr) == 0)
+    return true;
+
+  /* the socket is non-blocking, so the handshake usually
+   * finishes later. the socket turns writable once it has */
+  if (errno != EINPROGRESS)
     return (close(m_fd), m_fd = -1, true);
 
-  pollfd pfd;
-  pfd.fd = m_fd;
-  pfd.events = POLLOUT;
-  if (::poll(&pfd, 1, 0) < 0)
-    throw std::runtime_error("fatal poll error");
-  return pfd.revents & POLLOUT;
+  return false;
 }
 
 void
 TCPSocket::Connect::await_suspend(std::coroutine_handle<> handle)
 {
   auto rt = basic_handle_from_void(handle).promise().runtime;
-  rt->get_reactor().insert({ rt->create_waker(), m_fd, { false, true } });
+  rt->reactor_insert({ rt->create_waker(), m_fd, { false, true } });
 }
 
 std::optional<TCPSocket>
@@ -248,5 +575,10 @@ TCPSocket::Connect::await_resume()
   if (m_fd == -1u)
     return std::nullopt;
 
+  int err = 0;
+  socklen_t len = sizeof err;
+  if (getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+    return (close(m_fd), m_fd = -1, std::nullopt);
+
   return TCPSocket(m_fd, IPAddr(m_addr, m_port));
 }
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <expected>
+#include <format>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "tools/udp.hh"
+
+using namespace birdsong;
+
+void
+birdsong::borrow_buffers(std::span<RecvDatagram> out,
+                         std::vector<BufferPool::Buffer>& bufs,
+                         std::size_t size,
+                         BufferPool& pool)
+{
+  for (auto& datagram : out) {
+    auto& buf = bufs.emplace_back(pool.get(size));
+    datagram = RecvDatagram{ .buf = buf.span(),
+                             .len = 0,
+                             .from = IPAddr(0, 0),
+                             .truncated = false,
+                             .segment_size = 0 };
+  }
+}
+
+UDPSocket::UDPSocket(unsigned short port, std::uint32_t address)
+{
+  m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (m_fd == -1u)
+    throw std::runtime_error("unable to create udp socket");
+
+  struct sockaddr_in addr{};
+  addr.sin_addr.s_addr = htonl(address);
+  addr.sin_port = htons(port);
+  addr.sin_family = AF_INET;
+
+  if (bind(m_fd, (struct sockaddr const*)&addr, sizeof addr) < 0) {
+    close(m_fd);
+    throw std::runtime_error(
+      std::format("unable to bind udp socket {}", strerror(errno)));
+  }
+}
+
+UDPSocket::~UDPSocket()
+{
+  if (m_fd != -1u)
+    close(m_fd);
+}
+
+UDPSocket::UDPSocket(UDPSocket&& rhs)
+  : m_fd(rhs.m_fd)
+{
+  rhs.m_fd = -1u;
+}
+
+auto
+UDPSocket::recv_batch(std::span<RecvDatagram> out) -> RecvBatch
+{
+  return RecvBatch(*this, out);
+}
+
+auto
+UDPSocket::send_batch(std::span<SendDatagram const> in) -> SendBatch
+{
+  return SendBatch(*this, in);
+}
+
+IOResult<Empty>
+UDPSocket::set_gso(unsigned short segment_size)
+{
+  int val = segment_size;
+  if (setsockopt(m_fd, SOL_UDP, UDP_SEGMENT, &val, sizeof val) < 0)
+    return std::unexpected(errno);
+  return Empty{};
+}
+
+IOResult<Empty>
+UDPSocket::set_gro(bool enable)
+{
+  int val = enable;
+  if (setsockopt(m_fd, SOL_UDP, UDP_GRO, &val, sizeof val) < 0)
+    return std::unexpected(errno);
+  return Empty{};
+}
+
+IPAddr
+UDPSocket::local_addr() const
+{
+  struct sockaddr_in addr{};
+  socklen_t len = sizeof addr;
+  getsockname(m_fd, (struct sockaddr*)&addr, &len);
+  return IPAddr(ntohl(addr.sin_addr.s_addr), ntohs(addr.sin_port));
+}
+
+bool
+UDPSocket::RecvBatch::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+UDPSocket::RecvBatch::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+UDPSocket::RecvBatch::attempt()
+{
+  /* room for the gro segment size, the only control message asked for */
+  using Control = std::array<char, CMSG_SPACE(sizeof(int))>;
+
+  unsigned const count = std::min<std::size_t>(out.size(), MaxBatch);
+
+  std::array<struct mmsghdr, MaxBatch> hdrs;
+  std::array<struct iovec, MaxBatch> iovs;
+  std::array<struct sockaddr_in, MaxBatch> addrs;
+  alignas(struct cmsghdr) std::array<Control, MaxBatch> controls;
+
+  for (unsigned i = 0; i < count; i++) {
+    iovs[i] = { out[i].buf.data(), out[i].buf.size_bytes() };
+    hdrs[i] = {};
+    hdrs[i].msg_hdr.msg_name = &addrs[i];
+    hdrs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+    hdrs[i].msg_hdr.msg_iov = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+    hdrs[i].msg_hdr.msg_control = controls[i].data();
+    hdrs[i].msg_hdr.msg_controllen = controls[i].size();
+  }
+
+  int const n = recvmmsg(m_fd, hdrs.data(), count, MSG_DONTWAIT, nullptr);
+
+  for (int i = 0; i < n; i++) {
+    auto& dgram = out[i];
+    auto& msg = hdrs[i].msg_hdr;
+
+    dgram.len = hdrs[i].msg_len;
+    dgram.from =
+      IPAddr(ntohl(addrs[i].sin_addr.s_addr), ntohs(addrs[i].sin_port));
+    dgram.truncated = msg.msg_flags & MSG_TRUNC;
+    dgram.segment_size = 0;
+
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int size;
+        std::memcpy(&size, CMSG_DATA(cmsg), sizeof size);
+        dgram.segment_size = size;
+      }
+  }
+
+  return n;
+}
+
+bool
+UDPSocket::SendBatch::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+UDPSocket::SendBatch::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+UDPSocket::SendBatch::attempt()
+{
+  unsigned const count = std::min<std::size_t>(in.size(), MaxBatch);
+
+  std::array<struct mmsghdr, MaxBatch> hdrs;
+  std::array<struct iovec, MaxBatch> iovs;
+  std::array<struct sockaddr_in, MaxBatch> addrs;
+
+  for (unsigned i = 0; i < count; i++) {
+    addrs[i] = {};
+    addrs[i].sin_family = AF_INET;
+    addrs[i].sin_addr.s_addr = htonl(in[i].to.addr());
+    addrs[i].sin_port = htons(in[i].to.port());
+
+    /* sendmsg never writes through the iovec */
+    iovs[i] = { const_cast<std::byte*>(in[i].buf.data()),
+                in[i].buf.size_bytes() };
+
+    hdrs[i] = {};
+    hdrs[i].msg_hdr.msg_name = &addrs[i];
+    hdrs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+    hdrs[i].msg_hdr.msg_iov = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  return sendmmsg(m_fd, hdrs.data(), count, MSG_DONTWAIT);
+}
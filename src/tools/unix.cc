@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <expected>
+#include <format>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tools/unix.hh"
+
+using namespace birdsong;
+
+static int
+socket_type(UnixSocket::Kind kind)
+{
+  return kind == UnixSocket::Kind::Stream ? SOCK_STREAM : SOCK_SEQPACKET;
+}
+
+/* returns false if the path doesn't fit in a sockaddr_un */
+static bool
+make_addr(std::string_view path, struct sockaddr_un& addr)
+{
+  if (path.size() >= sizeof addr.sun_path)
+    return false;
+
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+UnixSocket::UnixSocket(unsigned fd)
+  : m_fd(fd) {};
+
+UnixSocket::~UnixSocket()
+{
+  if (m_fd != -1u)
+    close(m_fd);
+}
+
+UnixSocket::UnixSocket(UnixSocket&& rhs)
+  : m_fd(rhs.m_fd)
+{
+  rhs.m_fd = -1u;
+}
+
+UnixSocket&
+UnixSocket::operator=(UnixSocket&& rhs)
+{
+  this->~UnixSocket();
+  return *new (this) UnixSocket(std::move(rhs));
+}
+
+IOResult<UnixSocket>
+UnixSocket::connect(std::string_view path, Kind kind)
+{
+  struct sockaddr_un addr;
+  if (not make_addr(path, addr))
+    return std::unexpected(ENAMETOOLONG);
+
+  int const fd =
+    socket(AF_UNIX, socket_type(kind) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return std::unexpected(errno);
+
+  UnixSocket out(fd);
+  if (::connect(fd, (struct sockaddr const*)&addr, sizeof addr) < 0)
+    return std::unexpected(errno);
+
+  return out;
+}
+
+IOResult<std::pair<UnixSocket, UnixSocket>>
+UnixSocket::pair(Kind kind)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX,
+                 socket_type(kind) | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                 0,
+                 fds) < 0)
+    return std::unexpected(errno);
+
+  return std::pair<UnixSocket, UnixSocket>(UnixSocket(fds[0]),
+                                           UnixSocket(fds[1]));
+}
+
+auto
+UnixSocket::read(std::span<std::byte> buffer) -> Read
+{
+  return Read(*this, buffer);
+}
+
+auto
+UnixSocket::write(std::span<std::byte const> buffer) -> Write
+{
+  return Write(*this, buffer);
+}
+
+auto
+UnixSocket::send_fds(std::span<std::byte const> buf, std::span<int const> fds)
+  -> SendFDs
+{
+  return SendFDs(*this, buf, fds);
+}
+
+auto
+UnixSocket::recv_fds(std::span<std::byte> buf, std::span<int> fds) -> RecvFDs
+{
+  return RecvFDs(*this, buf, fds);
+}
+
+bool
+UnixSocket::Read::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+UnixSocket::Read::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+UnixSocket::Read::attempt()
+{
+  return ::recv(m_fd, buf.data(), buf.size(), MSG_DONTWAIT);
+}
+
+bool
+UnixSocket::Write::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+UnixSocket::Write::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+UnixSocket::Write::attempt()
+{
+  return ::send(m_fd, buf.data(), buf.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* control buffer big enough for MaxFDs descriptors */
+union FDControl
+{
+  struct cmsghdr align;
+  std::array<char, CMSG_SPACE(sizeof(int) * UnixSocket::MaxFDs)> buf;
+};
+
+bool
+UnixSocket::SendFDs::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<unsigned>
+UnixSocket::SendFDs::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  return take();
+}
+
+long
+UnixSocket::SendFDs::attempt()
+{
+  if (fds.size() > MaxFDs)
+    return (errno = EINVAL, -1);
+
+  /* sendmsg never writes through the iovec */
+  struct iovec iov = { const_cast<std::byte*>(buf.data()), buf.size() };
+  struct msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  FDControl control;
+  if (not fds.empty()) {
+    msg.msg_control = control.buf.data();
+    msg.msg_controllen = CMSG_SPACE(fds.size_bytes());
+
+    auto* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds.size_bytes());
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size_bytes());
+  }
+
+  return ::sendmsg(m_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+bool
+UnixSocket::RecvFDs::await_ready()
+{
+  return settle(attempt());
+}
+
+IOResult<UnixSocket::FDsReceived>
+UnixSocket::RecvFDs::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  auto const res = take();
+  if (not res)
+    return std::unexpected(res.error());
+
+  return FDsReceived{ *res, m_received };
+}
+
+long
+UnixSocket::RecvFDs::attempt()
+{
+  struct iovec iov = { buf.data(), buf.size() };
+  struct msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  FDControl control;
+  msg.msg_control = control.buf.data();
+  msg.msg_controllen = control.buf.size();
+
+  long const ret = ::recvmsg(m_fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (ret < 0)
+    return ret;
+
+  m_received = 0;
+  for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    unsigned const count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (unsigned i = 0; i < count; i++) {
+      int fd;
+      std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof fd);
+
+      /* we own every descriptor we were sent,
+       * so the ones with nowhere to go have to be closed here */
+      if (m_received < fds.size())
+        fds[m_received++] = fd;
+      else
+        close(fd);
+    }
+  }
+
+  return ret;
+}
+
+UnixListener::UnixListener(std::string path,
+                           UnixSocket::Kind kind,
+                           unsigned queue_size)
+  : m_path(std::move(path))
+{
+  struct sockaddr_un addr;
+  if (not make_addr(m_path, addr))
+    throw std::runtime_error("unix listener path is too long");
+
+  m_fd = socket(AF_UNIX, socket_type(kind) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (m_fd == -1u)
+    throw std::runtime_error("unable to create unix listener");
+
+  /* only a stale socket is removed, anything else at the
+   * path is left alone for bind to fail on */
+  struct stat st;
+  if (lstat(m_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(m_path.c_str());
+
+  if (bind(m_fd, (struct sockaddr const*)&addr, sizeof addr) < 0) {
+    close(m_fd);
+    throw std::runtime_error(
+      std::format("unable to bind unix listener {}", strerror(errno)));
+  }
+
+  if (listen(m_fd, queue_size) < 0) {
+    close(m_fd);
+    throw std::runtime_error("unable to listen unix listener socket");
+  }
+}
+
+UnixListener::~UnixListener()
+{
+  if (m_fd != -1u) {
+    close(m_fd);
+    unlink(m_path.c_str());
+  }
+}
+
+UnixListener::AcceptAwaiter::AcceptAwaiter(UnixListener& listener)
+  : SpeculativeIO(listener.m_fd, { true, false })
+  , listener(listener) {};
+
+auto
+UnixListener::accept() -> AcceptAwaiter
+{
+  return { *this };
+}
+
+bool
+UnixListener::AcceptAwaiter::await_ready()
+{
+  return settle(attempt());
+}
+
+long
+UnixListener::AcceptAwaiter::attempt()
+{
+  return ::accept4(
+    listener.m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+std::optional<UnixSocket>
+UnixListener::AcceptAwaiter::await_resume()
+{
+  if (not m_result)
+    settle(attempt());
+
+  auto const res = take();
+  if (not res)
+    return std::nullopt;
+
+  return UnixSocket(*res);
+}